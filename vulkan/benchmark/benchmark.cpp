@@ -0,0 +1,335 @@
+#include "vulkanapp.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <cstring>
+#include <cstdlib>
+
+// Runs the renderer headless over a grid of scene parameters and writes one
+// json result per configuration. With --baseline results are compared with earlier
+// run and process exits with 1 when frame time got worse by more than threshold.
+
+struct Parameter {
+	const char* name;
+	uint32_t VulkanApp::Options::* field;
+};
+
+static const Parameter parameters[] = {
+	{ "triangles", &VulkanApp::Options::streamTriangles },
+	{ "draws", &VulkanApp::Options::drawCount },
+	{ "instances", &VulkanApp::Options::instanceCount },
+	{ "particles", &VulkanApp::Options::particleCount },
+	{ "cull-objects", &VulkanApp::Options::cullObjects },
+	{ "index-bits", &VulkanApp::Options::indexBits },
+	{ "variant", &VulkanApp::Options::pipelineVariant },
+	{ "threads", &VulkanApp::Options::recordThreads },
+	{ "frames-in-flight", &VulkanApp::Options::framesInFlight },
+};
+
+struct Sweep {
+	const Parameter* parameter;
+	std::vector<uint32_t> values;
+};
+
+struct Result {
+	std::string name;
+	bool failed = false;
+	VulkanApp::Results results;
+};
+
+struct BaselineEntry {
+	double p50 = 0.0;
+	double p99 = 0.0;
+};
+
+static const Parameter* findParameter(const std::string& name)
+{
+	for (const auto& parameter : parameters) {
+		if (name == parameter.name)
+			return &parameter;
+	}
+
+	return nullptr;
+}
+
+// "draws=1,100,10000"
+static Sweep parseSweep(const std::string& text)
+{
+	auto equal = text.find('=');
+	if (equal == std::string::npos)
+		throw std::runtime_error("sweep must look like name=value,value: " + text);
+
+	Sweep sweep;
+	sweep.parameter = findParameter(text.substr(0, equal));
+	if (!sweep.parameter)
+		throw std::runtime_error("unknown sweep parameter " + text.substr(0, equal));
+
+	std::stringstream values(text.substr(equal + 1));
+	std::string value;
+	while (std::getline(values, value, ','))
+		sweep.values.push_back((uint32_t)std::strtoul(value.c_str(), nullptr, 10));
+
+	if (sweep.values.empty())
+		throw std::runtime_error("sweep without values: " + text);
+
+	return sweep;
+}
+
+static std::string jsonString(const std::string& text)
+{
+	std::string result = "\"";
+	for (char c : text) {
+		if (c == '"' || c == '\\')
+			result += '\\';
+		result += c;
+	}
+
+	return result + '"';
+}
+
+// results are written by us one per line, so baseline needs no real json parser
+static bool findNumber(const std::string& line, const std::string& key, double& value)
+{
+	auto pos = line.find("\"" + key + "\":");
+	if (pos == std::string::npos)
+		return false;
+
+	value = std::strtod(line.c_str() + pos + key.size() + 3, nullptr);
+	return true;
+}
+
+static std::map<std::string, BaselineEntry> loadBaseline(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+		throw std::runtime_error("failed to open baseline " + path);
+
+	std::map<std::string, BaselineEntry> baseline;
+	std::string line;
+	while (std::getline(file, line)) {
+		auto pos = line.find("{\"name\":\"");
+		if (pos == std::string::npos)
+			continue;
+
+		pos += 9;
+		std::string name = line.substr(pos, line.find('"', pos) - pos);
+
+		BaselineEntry entry;
+		if (findNumber(line, "p50", entry.p50) && findNumber(line, "p99", entry.p99))
+			baseline[name] = entry;
+	}
+
+	return baseline;
+}
+
+static void writeResults(std::ostream& out, const std::vector<Result>& results, uint32_t warmupFrames, uint32_t measuredFrames)
+{
+	out << std::fixed << std::setprecision(4);
+
+	std::string device = results.empty() ? "" : results.front().results.deviceName;
+	out << "{\"device\":" << jsonString(device) << ",\"warmupFrames\":" << warmupFrames
+		<< ",\"measuredFrames\":" << measuredFrames << ",\"results\":[\n";
+
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& result = results[i];
+		const auto& frames = result.results.frames;
+
+		out << "{\"name\":" << jsonString(result.name);
+		if (result.failed) {
+			out << ",\"failed\":true}";
+		}
+		else {
+			out << ",\"frames\":" << frames.frameCount
+				<< ",\"fps\":" << (frames.duration > 0.0 ? frames.frameCount / frames.duration : 0.0)
+				<< ",\"p50\":" << frames.frameTime.p50 << ",\"p95\":" << frames.frameTime.p95
+				<< ",\"p99\":" << frames.frameTime.p99 << ",\"max\":" << frames.frameTime.max
+				<< ",\"hitches\":" << frames.hitchCount << ",\"startup\":" << result.results.startupTime
+				<< ",\"pipelines\":" << result.results.pipelineTime
+				<< ",\"pipelineCache\":" << (result.results.pipelineCacheWarm ? "\"warm\"" : "\"cold\"") << ",\"phases\":{";
+
+			for (uint32_t p = 0; p < FrameTelemetry::PHASE_COUNT; ++p) {
+				out << (p ? "," : "") << jsonString(FrameTelemetry::phaseName((FrameTelemetry::Phase)p))
+					<< ":" << frames.phases[p].p50;
+			}
+
+			out << "},\"counters\":{";
+			for (size_t c = 0; c < frames.counters.size(); ++c)
+				out << (c ? "," : "") << jsonString(frames.counters[c].first) << ":" << frames.counters[c].second;
+			out << "}}";
+		}
+
+		out << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+
+	out << "]}\n";
+}
+
+static void printUsage()
+{
+	std::cout << "benchmark [options]\n"
+		<< "  --warmup N            frames rendered before measuring (default 60)\n"
+		<< "  --frames N            measured frames per configuration (default 300)\n"
+		<< "  --sweep name=a,b,c    parameter values, repeat for grid; names:";
+	for (const auto& parameter : parameters)
+		std::cout << ' ' << parameter.name;
+	std::cout << "\n  --device NAME         use device whose name contains NAME (e.g. llvmpipe)\n"
+		<< "  --window              present to window instead of offscreen images\n"
+		<< "  --compact             use 8 byte vertex layout in every configuration\n"
+		<< "  --output FILE         write results json (default benchmark.json)\n"
+		<< "  --baseline FILE       compare with earlier results\n"
+		<< "  --threshold PERCENT   allowed frame time growth over baseline (default 10)\n";
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t warmupFrames = 60;
+	uint32_t measuredFrames = 300;
+	std::vector<Sweep> sweeps;
+	std::string deviceName;
+	bool window = false;
+	bool compact = false;
+	std::string outputPath = "benchmark.json";
+	std::string baselinePath;
+	double threshold = 10.0;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			bool hasValue = i + 1 < argc;
+
+			if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+				warmupFrames = (uint32_t)std::atoi(argv[++i]);
+			else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+				measuredFrames = (uint32_t)std::atoi(argv[++i]);
+			else if (strcmp(argv[i], "--sweep") == 0 && hasValue)
+				sweeps.push_back(parseSweep(argv[++i]));
+			else if (strcmp(argv[i], "--device") == 0 && hasValue)
+				deviceName = argv[++i];
+			else if (strcmp(argv[i], "--window") == 0)
+				window = true;
+			else if (strcmp(argv[i], "--compact") == 0)
+				compact = true;
+			else if (strcmp(argv[i], "--output") == 0 && hasValue)
+				outputPath = argv[++i];
+			else if (strcmp(argv[i], "--baseline") == 0 && hasValue)
+				baselinePath = argv[++i];
+			else if (strcmp(argv[i], "--threshold") == 0 && hasValue)
+				threshold = std::atof(argv[++i]);
+			else {
+				printUsage();
+				return 2;
+			}
+		}
+
+		// default scene set: static triangle, then growing streamed geometry and draw counts
+		if (sweeps.empty()) {
+			sweeps.push_back(parseSweep("triangles=0,1000,100000"));
+			sweeps.push_back(parseSweep("draws=1,10000"));
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		printUsage();
+		return 2;
+	}
+
+	// walk the grid like an odometer, last sweep changes fastest
+	std::vector<Result> results;
+	std::vector<size_t> position(sweeps.size(), 0);
+
+	for (bool done = false; !done; ) {
+		VulkanApp::Options options;
+		options.headless = !window;
+		options.compactVertices = compact;
+		options.warmupFrames = warmupFrames;
+		options.frameCount = warmupFrames + measuredFrames + 1;	// interval of last frame ends at next one
+		options.deviceName = deviceName;
+		options.verbose = false;
+
+		Result result;
+		for (size_t s = 0; s < sweeps.size(); ++s) {
+			uint32_t value = sweeps[s].values[position[s]];
+			options.*(sweeps[s].parameter->field) = value;
+			result.name += (s ? " " : "") + std::string(sweeps[s].parameter->name) + "=" + std::to_string(value);
+		}
+
+		std::cout << result.name << "... " << std::flush;
+
+		try {
+			VulkanApp app(options);
+			app.run();
+			result.results = app.results();
+
+			std::cout << std::fixed << std::setprecision(3) << "p50 " << result.results.frames.frameTime.p50
+				<< " ms, p99 " << result.results.frames.frameTime.p99 << " ms, pipelines " << result.results.pipelineTime
+				<< " ms (" << (result.results.pipelineCacheWarm ? "warm" : "cold") << " cache)" << std::endl;
+		}
+		catch (const std::exception& e) {
+			result.failed = true;
+			std::cout << "failed: " << e.what() << std::endl;
+		}
+
+		results.push_back(result);
+
+		done = true;
+		for (size_t s = sweeps.size(); s-- > 0; ) {
+			if (++position[s] < sweeps[s].values.size()) {
+				done = false;
+				break;
+			}
+			position[s] = 0;
+		}
+	}
+
+	std::ofstream output(outputPath, std::ios::out | std::ios::trunc);
+	if (!output.is_open()) {
+		std::cerr << "failed to open " << outputPath << std::endl;
+		return 2;
+	}
+	writeResults(output, results, warmupFrames, measuredFrames);
+	output.close();
+
+	if (!results.empty())
+		std::cout << "Device: " << results.front().results.deviceName << "\nResults: " << outputPath << std::endl;
+
+	if (baselinePath.empty())
+		return 0;
+
+	std::map<std::string, BaselineEntry> baseline;
+	try {
+		baseline = loadBaseline(baselinePath);
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 2;
+	}
+
+	// p99 catches stutter regressions that median hides
+	int regressions = 0;
+	double limit = 1.0 + threshold / 100.0;
+
+	std::cout << "\nComparison with " << baselinePath << " (threshold " << threshold << "%)\n";
+	for (const auto& result : results) {
+		auto it = baseline.find(result.name);
+		if (it == baseline.end() || result.failed) {
+			std::cout << result.name << ": " << (result.failed ? "failed" : "no baseline") << '\n';
+			regressions += result.failed ? 1 : 0;
+			continue;
+		}
+
+		const auto& frames = result.results.frames;
+		double p50Ratio = it->second.p50 > 0.0 ? frames.frameTime.p50 / it->second.p50 : 1.0;
+		double p99Ratio = it->second.p99 > 0.0 ? frames.frameTime.p99 / it->second.p99 : 1.0;
+		bool regressed = p50Ratio > limit || p99Ratio > limit;
+		regressions += regressed ? 1 : 0;
+
+		std::cout << result.name << ": p50 " << std::showpos << (p50Ratio - 1.0) * 100.0 << "%, p99 "
+			<< (p99Ratio - 1.0) * 100.0 << "%" << std::noshowpos << (regressed ? "  REGRESSION" : "") << '\n';
+	}
+
+	std::cout << regressions << " regression(s)" << std::endl;
+	return regressions ? 1 : 0;
+}
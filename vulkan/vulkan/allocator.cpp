@@ -0,0 +1,322 @@
+#include "allocator.h"
+#include <stdexcept>
+#include <algorithm>
+
+const VkDeviceSize Allocator::MIN_ALLOCATION;
+const VkDeviceSize Allocator::MAX_BLOCK_SIZE;
+
+void Allocator::init(VkPhysicalDevice physicalDevice, VkDevice device)
+{
+	device_ = device;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties_);
+
+	// block is power of two no bigger than 1/8 of its heap, so small heaps (like BAR) aren't exhausted by one block
+	for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; ++i) {
+		VkDeviceSize heapSize = memoryProperties_.memoryHeaps[memoryProperties_.memoryTypes[i].heapIndex].size;
+		VkDeviceSize blockSize = MAX_BLOCK_SIZE;
+		while (blockSize > MIN_ALLOCATION * 4096 && blockSize > heapSize / 8)
+			blockSize /= 2;
+
+		blockSize_[i] = blockSize;
+	}
+
+	pools_.resize(memoryProperties_.memoryTypeCount * 2);
+}
+
+void Allocator::destroy()
+{
+	for (auto& pool : pools_) {
+		for (auto& block : pool.blocks) {
+			if (block.memory)
+				destroyBlock(block);
+		}
+	}
+
+	pools_.clear();
+	stats_ = Stats();
+}
+
+Allocation Allocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	Allocation allocation;
+	allocation.memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+	allocation.size = requirements.size;
+	allocation.linear = linear;
+
+	VkDeviceSize blockSize = blockSize_[allocation.memoryType];
+
+	if (requirements.size > blockSize / 2) {
+		allocation.memory = allocateMemory(requirements.size, allocation.memoryType, allocation.mapped);
+		allocation.block = -1;
+
+		stats_.reservedBytes += requirements.size;
+		stats_.usedBytes += requirements.size;
+		++stats_.dedicatedCount;
+	}
+	else {
+		// buddy offsets are multiples of their size, so rounding size up to alignment aligns offset too
+		VkDeviceSize size = std::max(requirements.size, std::max(requirements.alignment, MIN_ALLOCATION));
+		uint32_t order = 0;
+		while ((MIN_ALLOCATION << order) < size)
+			++order;
+
+		auto& pool = pools_[allocation.memoryType * 2 + (linear ? 1 : 0)];
+		VkDeviceSize offset = 0;
+		int32_t blockIndex = -1;
+
+		for (size_t i = 0; i < pool.blocks.size(); ++i) {
+			if (pool.blocks[i].memory && allocateFromBlock(pool.blocks[i], order, offset)) {
+				blockIndex = (int32_t)i;
+				break;
+			}
+		}
+
+		if (blockIndex < 0) {
+			// reuse slot of released block, so indices of live blocks stay stable
+			auto it = std::find_if(pool.blocks.begin(), pool.blocks.end(), [](const Block& b) { return !b.memory; });
+			if (it == pool.blocks.end())
+				it = pool.blocks.insert(pool.blocks.end(), Block());
+
+			createBlock(*it, allocation.memoryType);
+			allocateFromBlock(*it, order, offset);
+			blockIndex = (int32_t)(it - pool.blocks.begin());
+		}
+
+		auto& block = pool.blocks[blockIndex];
+		allocation.memory = block.memory;
+		allocation.offset = offset;
+		allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+		allocation.block = blockIndex;
+		allocation.order = order;
+
+		stats_.usedBytes += MIN_ALLOCATION << order;
+	}
+
+	stats_.liveBytes += allocation.size;
+	++stats_.allocationCount;
+
+	return allocation;
+}
+
+void Allocator::free(Allocation& allocation)
+{
+	if (!allocation.memory)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (allocation.block < 0) {
+		vkFreeMemory(device_, allocation.memory, nullptr);
+
+		stats_.reservedBytes -= allocation.size;
+		stats_.usedBytes -= allocation.size;
+		--stats_.dedicatedCount;
+	}
+	else {
+		auto& pool = pools_[allocation.memoryType * 2 + (allocation.linear ? 1 : 0)];
+		auto& block = pool.blocks[allocation.block];
+
+		freeToBlock(block, allocation.order, allocation.offset, maxOrder(allocation.memoryType));
+		stats_.usedBytes -= MIN_ALLOCATION << allocation.order;
+
+		// give empty block back to driver, but keep the last one to avoid churn
+		if (block.freeBytes == block.size) {
+			auto liveBlocks = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const Block& b) { return b.memory != VK_NULL_HANDLE; });
+			if (liveBlocks > 1)
+				destroyBlock(block);
+		}
+	}
+
+	stats_.liveBytes -= allocation.size;
+	--stats_.allocationCount;
+
+	allocation = Allocation();
+}
+
+void Allocator::createBuffer(const VkBufferCreateInfo& createInfo, VkMemoryPropertyFlags properties,
+	VkBuffer& buffer, Allocation& allocation)
+{
+	if (vkCreateBuffer(device_, &createInfo, nullptr, &buffer) != VK_SUCCESS)
+		throw std::runtime_error("failed to create buffer!");
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(device_, buffer, &memoryRequirements);
+
+	allocation = allocate(memoryRequirements, properties, true);
+	vkBindBufferMemory(device_, buffer, allocation.memory, allocation.offset);
+}
+
+void Allocator::createImage(const VkImageCreateInfo& createInfo, VkMemoryPropertyFlags properties,
+	VkImage& image, Allocation& allocation)
+{
+	if (vkCreateImage(device_, &createInfo, nullptr, &image) != VK_SUCCESS)
+		throw std::runtime_error("failed to create image!");
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(device_, image, &memoryRequirements);
+
+	allocation = allocate(memoryRequirements, properties, createInfo.tiling == VK_IMAGE_TILING_LINEAR);
+	vkBindImageMemory(device_, image, allocation.memory, allocation.offset);
+}
+
+void Allocator::destroyBuffer(VkBuffer& buffer, Allocation& allocation)
+{
+	if (buffer) {
+		vkDestroyBuffer(device_, buffer, nullptr);
+		buffer = VK_NULL_HANDLE;
+	}
+
+	free(allocation);
+}
+
+void Allocator::destroyImage(VkImage& image, Allocation& allocation)
+{
+	if (image) {
+		vkDestroyImage(device_, image, nullptr);
+		image = VK_NULL_HANDLE;
+	}
+
+	free(allocation);
+}
+
+uint32_t Allocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; ++i) {
+		if (typeFilter & (1 << i) &&
+			(memoryProperties_.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	}
+
+	throw std::runtime_error("failed to find suitable memory type!");
+}
+
+Allocator::Stats Allocator::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	Stats stats = stats_;
+	stats.blockCount = 0;
+
+	VkDeviceSize totalFree = 0;
+	VkDeviceSize largestFree = 0;
+
+	for (const auto& pool : pools_) {
+		for (const auto& block : pool.blocks) {
+			if (!block.memory)
+				continue;
+
+			++stats.blockCount;
+			totalFree += block.freeBytes;
+
+			for (size_t order = block.freeLists.size(); order-- > 0; ) {
+				if (!block.freeLists[order].empty()) {
+					largestFree = std::max(largestFree, MIN_ALLOCATION << order);
+					break;
+				}
+			}
+		}
+	}
+
+	stats.fragmentation = totalFree ? 1.0f - (float)largestFree / (float)totalFree : 0.0f;
+
+	return stats;
+}
+
+// private functions
+uint32_t Allocator::maxOrder(uint32_t memoryType) const
+{
+	uint32_t order = 0;
+	while ((MIN_ALLOCATION << order) < blockSize_[memoryType])
+		++order;
+
+	return order;
+}
+
+bool Allocator::allocateFromBlock(Block& block, uint32_t order, VkDeviceSize& offset)
+{
+	// smallest free range that fits
+	uint32_t current = order;
+	while (current < block.freeLists.size() && block.freeLists[current].empty())
+		++current;
+
+	if (current >= block.freeLists.size())
+		return false;
+
+	offset = *block.freeLists[current].begin();
+	block.freeLists[current].erase(block.freeLists[current].begin());
+
+	// split it down, upper halves go to free lists
+	while (current > order) {
+		--current;
+		block.freeLists[current].insert(offset + (MIN_ALLOCATION << current));
+	}
+
+	block.freeBytes -= MIN_ALLOCATION << order;
+
+	return true;
+}
+
+void Allocator::freeToBlock(Block& block, uint32_t order, VkDeviceSize offset, uint32_t blockMaxOrder)
+{
+	block.freeBytes += MIN_ALLOCATION << order;
+
+	// merge with free buddies as far as possible
+	while (order < blockMaxOrder) {
+		VkDeviceSize buddy = offset ^ (MIN_ALLOCATION << order);
+		auto it = block.freeLists[order].find(buddy);
+		if (it == block.freeLists[order].end())
+			break;
+
+		block.freeLists[order].erase(it);
+		offset = std::min(offset, buddy);
+		++order;
+	}
+
+	block.freeLists[order].insert(offset);
+}
+
+void Allocator::createBlock(Block& block, uint32_t memoryType)
+{
+	uint32_t order = maxOrder(memoryType);
+
+	block.memory = allocateMemory(blockSize_[memoryType], memoryType, block.mapped);
+	block.size = blockSize_[memoryType];
+	block.freeBytes = block.size;
+	block.freeLists.assign(order + 1, std::set<VkDeviceSize>());
+	block.freeLists[order].insert(0);
+
+	stats_.reservedBytes += block.size;
+}
+
+void Allocator::destroyBlock(Block& block)
+{
+	// memory is unmapped implicitly when freed
+	vkFreeMemory(device_, block.memory, nullptr);
+
+	stats_.reservedBytes -= block.size;
+
+	block = Block();
+}
+
+VkDeviceMemory Allocator::allocateMemory(VkDeviceSize size, uint32_t memoryType, void*& mapped)
+{
+	VkMemoryAllocateInfo allocInfo = { };
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	if (vkAllocateMemory(device_, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		throw std::runtime_error("failed to allocate device memory!");
+
+	// host visible memory stays mapped for its whole life
+	mapped = nullptr;
+	if (memoryProperties_.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(device_, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+			throw std::runtime_error("failed to map device memory!");
+	}
+
+	return memory;
+}
@@ -0,0 +1,90 @@
+#ifndef ALLOCATOR_H_
+#define ALLOCATOR_H_
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <set>
+#include <mutex>
+
+// piece of device memory handed out by Allocator
+struct Allocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr;			// host address of offset, null if memory is not host visible
+
+	// allocator bookkeeping
+	uint32_t memoryType = 0;
+	bool linear = true;
+	int32_t block = -1;				// -1 for dedicated allocation
+	uint32_t order = 0;
+};
+
+// Sub-allocates resources from large VkDeviceMemory blocks, one set of blocks per memory type.
+// Blocks are split with buddy system, so every allocation is a power of two aligned to its size.
+// Linear (buffers) and optimal (images) resources never share a block, so bufferImageGranularity
+// can't be violated. Resources bigger than half a block get dedicated allocation.
+class Allocator {
+public:
+	struct Stats {
+		VkDeviceSize liveBytes = 0;			// requested by live allocations
+		VkDeviceSize usedBytes = 0;			// taken from blocks after rounding, plus dedicated
+		VkDeviceSize reservedBytes = 0;		// total device memory allocated
+		uint32_t allocationCount = 0;
+		uint32_t blockCount = 0;
+		uint32_t dedicatedCount = 0;
+		float fragmentation = 0.0f;			// 1 - largest free range / total free space
+	};
+
+private:
+	struct Block {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void* mapped = nullptr;
+		VkDeviceSize size = 0;
+		VkDeviceSize freeBytes = 0;
+		std::vector<std::set<VkDeviceSize>> freeLists;		// free offsets for every order
+	};
+
+	struct Pool {
+		std::vector<Block> blocks;
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties_ = { };
+	VkDeviceSize blockSize_[VK_MAX_MEMORY_TYPES] = { };
+	std::vector<Pool> pools_;			// [memoryType * 2 + linear]
+
+	Stats stats_;
+	std::mutex mutex_;
+
+	static const VkDeviceSize MIN_ALLOCATION = 256;
+	static const VkDeviceSize MAX_BLOCK_SIZE = 64 * 1024 * 1024;
+
+private:
+	uint32_t maxOrder(uint32_t memoryType) const;
+	bool allocateFromBlock(Block&, uint32_t order, VkDeviceSize& offset);
+	void freeToBlock(Block&, uint32_t order, VkDeviceSize offset, uint32_t blockMaxOrder);
+	void createBlock(Block&, uint32_t memoryType);
+	void destroyBlock(Block&);
+	VkDeviceMemory allocateMemory(VkDeviceSize, uint32_t memoryType, void*& mapped);
+
+public:
+	void init(VkPhysicalDevice, VkDevice);
+	void destroy();
+
+	Allocation allocate(const VkMemoryRequirements&, VkMemoryPropertyFlags, bool linear);
+	void free(Allocation&);
+
+	// create resource and bind it to sub-allocated memory
+	void createBuffer(const VkBufferCreateInfo&, VkMemoryPropertyFlags, VkBuffer&, Allocation&);
+	void createImage(const VkImageCreateInfo&, VkMemoryPropertyFlags, VkImage&, Allocation&);
+	void destroyBuffer(VkBuffer&, Allocation&);
+	void destroyImage(VkImage&, Allocation&);
+
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags) const;
+	const VkPhysicalDeviceMemoryProperties& memoryProperties() const { return memoryProperties_; }
+
+	Stats getStats();
+};
+
+#endif // ALLOCATOR_H_
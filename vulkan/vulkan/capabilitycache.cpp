@@ -0,0 +1,121 @@
+#include "capabilitycache.h"
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+const uint32_t CapabilityCache::MAGIC;
+const uint32_t CapabilityCache::VERSION;
+
+void CapabilityCache::load(const std::string& path)
+{
+	path_ = path;
+	data_ = { };
+	dirty_ = false;
+
+	std::ifstream file(path_, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return;
+
+	FileData data = { };
+	if (!file.read(reinterpret_cast<char*>(&data), sizeof(data)))
+		return;
+
+	if (data.magic == MAGIC && data.version == VERSION)
+		data_ = data;
+}
+
+void CapabilityCache::save()
+{
+	if (!dirty_ || path_.empty())
+		return;
+
+	data_.magic = MAGIC;
+	data_.version = VERSION;
+
+	// same swap as pipeline cache, half written file is never read
+	std::string tmpPath = path_ + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return;
+
+		file.write(reinterpret_cast<const char*>(&data_), sizeof(data_));
+		file.flush();
+
+		if (!file.good()) {
+			file.close();
+			std::remove(tmpPath.c_str());
+			return;
+		}
+	}
+
+#ifdef _WIN32
+	MoveFileExA(tmpPath.c_str(), path_.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	std::rename(tmpPath.c_str(), path_.c_str());
+#endif
+	dirty_ = false;
+}
+
+void CapabilityCache::clear()
+{
+	data_ = { };
+	dirty_ = true;
+}
+
+void CapabilityCache::setInstance(uint64_t key)
+{
+	if (data_.instanceKey == key)
+		return;
+
+	data_.instanceKey = key;
+	dirty_ = true;
+}
+
+bool CapabilityCache::hasDevice(uint64_t key, const VkPhysicalDeviceProperties& properties) const
+{
+	return key && data_.deviceKey == key && isSameDevice(properties);
+}
+
+void CapabilityCache::setDevice(uint64_t key, const VkPhysicalDeviceProperties& properties)
+{
+	if (hasDevice(key, properties))
+		return;
+
+	data_.deviceKey = key;
+	data_.vendorID = properties.vendorID;
+	data_.deviceID = properties.deviceID;
+	data_.driverVersion = properties.driverVersion;
+	memcpy(data_.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	dirty_ = true;
+}
+
+uint64_t CapabilityCache::hashNames(const std::vector<const char*>& names)
+{
+	// FNV-1a, zero byte after each name keeps "ab","c" apart from "a","bc"
+	uint64_t hash = 14695981039346656037ull;
+	for (const char* name : names) {
+		for (const char* c = name; ; ++c) {
+			hash ^= (uint8_t)*c;
+			hash *= 1099511628211ull;
+			if (!*c)
+				break;
+		}
+	}
+
+	return hash;
+}
+
+// private functions
+bool CapabilityCache::isSameDevice(const VkPhysicalDeviceProperties& properties) const
+{
+	// driver update may change extension list
+	return data_.vendorID == properties.vendorID && data_.deviceID == properties.deviceID &&
+		data_.driverVersion == properties.driverVersion &&
+		memcmp(data_.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
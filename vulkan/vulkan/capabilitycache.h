@@ -0,0 +1,48 @@
+#ifndef CAPABILITYCACHE_H_
+#define CAPABILITYCACHE_H_
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+// Outcome of instance and device capability checks, kept on disk between runs.
+// Layer and extension enumeration makes the loader parse every manifest, so checks that
+// passed last time are skipped while requested names, device and driver stay the same.
+// Entry is only a hint: if creation fails anyway, caller clears it and checks again.
+class CapabilityCache {
+	struct FileData {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t instanceKey;		// requested layers and instance extensions, 0 - not checked
+		uint64_t deviceKey;			// requested device extensions, 0 - not checked
+		uint32_t vendorID;			// device that has them
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	};
+
+	static const uint32_t MAGIC = 0x50414356;	// "VCAP"
+	static const uint32_t VERSION = 1;
+
+	std::string path_;
+	FileData data_ = { };
+	bool dirty_ = false;
+
+private:
+	bool isSameDevice(const VkPhysicalDeviceProperties&) const;
+
+public:
+	void load(const std::string& path);
+	void save();		// writes only if something changed
+	void clear();
+
+	bool hasInstance(uint64_t key) const { return key && data_.instanceKey == key; }
+	void setInstance(uint64_t key);
+
+	bool hasDevice(uint64_t key, const VkPhysicalDeviceProperties&) const;
+	void setDevice(uint64_t key, const VkPhysicalDeviceProperties&);
+
+	static uint64_t hashNames(const std::vector<const char*>& names);
+};
+
+#endif // CAPABILITYCACHE_H_
@@ -0,0 +1,103 @@
+#include "commandrecorder.h"
+#include <stdexcept>
+#include <algorithm>
+
+void CommandRecorder::init(VkDevice device, uint32_t queueFamily, uint32_t frameCount, ThreadPool* threadPool)
+{
+	device_ = device;
+	threadPool_ = threadPool;
+	threadCount_ = threadPool_->threadCount();
+	threadFrames_.resize(frameCount * threadCount_);
+
+	for (auto& threadFrame : threadFrames_) {
+		VkCommandPoolCreateInfo createInfo = { };
+		createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		createInfo.queueFamilyIndex = queueFamily;
+
+		if (vkCreateCommandPool(device_, &createInfo, nullptr, &threadFrame.commandPool) != VK_SUCCESS)
+			throw std::runtime_error("failed to create recording command pool");
+	}
+}
+
+void CommandRecorder::destroy()
+{
+	for (auto& threadFrame : threadFrames_) {
+		if (threadFrame.commandPool)
+			vkDestroyCommandPool(device_, threadFrame.commandPool, nullptr);
+	}
+	threadFrames_.clear();
+}
+
+void CommandRecorder::beginFrame(uint32_t frameIndex)
+{
+	currentFrame_ = frameIndex;
+
+	for (uint32_t thread = 0; thread < threadCount_; ++thread) {
+		auto& threadFrame = threadFrames_[currentFrame_ * threadCount_ + thread];
+		if (threadFrame.used) {
+			vkResetCommandPool(device_, threadFrame.commandPool, 0);
+			threadFrame.used = 0;
+		}
+	}
+}
+
+void CommandRecorder::record(const VkCommandBufferInheritanceInfo& inheritanceInfo, uint32_t itemCount, uint32_t minSliceSize,
+	const std::function<void(VkCommandBuffer, uint32_t first, uint32_t count)>& recordSlice,
+	std::vector<VkCommandBuffer>& commandBuffers)
+{
+	if (itemCount == 0)
+		return;
+
+	// few slices per thread even out uneven workers without making buffers too small
+	minSliceSize = std::max(minSliceSize, 1u);
+	uint32_t sliceCount = std::min(threadCount_ * 2, (itemCount + minSliceSize - 1) / minSliceSize);
+	uint32_t sliceSize = (itemCount + sliceCount - 1) / sliceCount;
+
+	size_t firstBuffer = commandBuffers.size();
+	commandBuffers.resize(firstBuffer + sliceCount, VK_NULL_HANDLE);
+
+	threadPool_->parallelFor(sliceCount, [&](uint32_t slice, uint32_t thread) {
+		uint32_t first = slice * sliceSize;
+		uint32_t count = first < itemCount ? std::min(sliceSize, itemCount - first) : 0;
+
+		VkCommandBuffer commandBuffer = getCommandBuffer(thread);
+
+		VkCommandBufferBeginInfo beginInfo = { };
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		if (count)
+			recordSlice(commandBuffer, first, count);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("failed to record secondary command buffer!");
+
+		commandBuffers[firstBuffer + slice] = commandBuffer;
+	});
+}
+
+// private functions
+VkCommandBuffer CommandRecorder::getCommandBuffer(uint32_t thread)
+{
+	// only this thread touches its pool during recording
+	auto& threadFrame = threadFrames_[currentFrame_ * threadCount_ + thread];
+
+	if (threadFrame.used == threadFrame.commandBuffers.size()) {
+		VkCommandBufferAllocateInfo allocInfo = { };
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = threadFrame.commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		if (vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("failed to allocate secondary command buffer!");
+
+		threadFrame.commandBuffers.push_back(commandBuffer);
+	}
+
+	return threadFrame.commandBuffers[threadFrame.used++];
+}
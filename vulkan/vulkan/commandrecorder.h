@@ -0,0 +1,43 @@
+#ifndef COMMANDRECORDER_H_
+#define COMMANDRECORDER_H_
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <functional>
+#include "threadpool.h"
+
+// Records secondary command buffers for slices of a draw list on pool threads.
+// Every worker owns transient command pool per frame in flight, so workers never share a pool
+// and frame resets all its pools at once after its fence was waited on.
+class CommandRecorder {
+	struct ThreadFrame {
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> commandBuffers;		// allocated once, reused after pool reset
+		size_t used = 0;
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	ThreadPool* threadPool_ = nullptr;
+	uint32_t threadCount_ = 0;
+	std::vector<ThreadFrame> threadFrames_;		// [frame * threadCount + thread]
+	uint32_t currentFrame_ = 0;
+
+private:
+	VkCommandBuffer getCommandBuffer(uint32_t thread);
+
+public:
+	void init(VkDevice, uint32_t queueFamily, uint32_t frameCount, ThreadPool*);
+	void destroy();
+
+	// reset pools of frame slot, gpu must be done with it
+	void beginFrame(uint32_t frameIndex);
+
+	// split itemCount items in slices of at least minSliceSize and record every slice into
+	// its own secondary buffer with recordSlice(commandBuffer, first, count) on worker threads.
+	// Buffers are appended to commandBuffers in slice order, ready for vkCmdExecuteCommands
+	void record(const VkCommandBufferInheritanceInfo&, uint32_t itemCount, uint32_t minSliceSize,
+		const std::function<void(VkCommandBuffer, uint32_t first, uint32_t count)>& recordSlice,
+		std::vector<VkCommandBuffer>& commandBuffers);
+};
+
+#endif // COMMANDRECORDER_H_
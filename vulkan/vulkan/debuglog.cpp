@@ -0,0 +1,216 @@
+#include "debuglog.h"
+#include <chrono>
+#include <cstring>
+
+const uint32_t DebugLog::CAPACITY;
+const uint32_t DebugLog::MAX_PREFIX;
+const uint32_t DebugLog::MAX_MESSAGE;
+const uint32_t DebugLog::MAX_ENTRIES;
+
+void DebugLog::start(std::ostream& out, double summaryInterval)
+{
+	stop();
+
+	slots_.reset(new Slot[CAPACITY]);
+	for (uint32_t i = 0; i < CAPACITY; ++i)
+		slots_[i].sequence.store(i, std::memory_order_relaxed);
+
+	writePosition_.store(0, std::memory_order_relaxed);
+	readPosition_ = 0;
+	dropped_.store(0, std::memory_order_relaxed);
+
+	entries_.clear();
+	messages_.store(0, std::memory_order_relaxed);
+	unique_.store(0, std::memory_order_relaxed);
+	for (auto& count : severities_)
+		count.store(0, std::memory_order_relaxed);
+	reportedDropped_ = 0;
+	out_ = &out;
+	summaryInterval_ = summaryInterval;
+	stop_ = false;
+
+	drainer_ = std::thread(&DebugLog::drainLoop, this);
+}
+
+void DebugLog::stop()
+{
+	if (!drainer_.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	wake_.notify_all();
+	drainer_.join();
+}
+
+bool DebugLog::push(VkDebugReportFlagsEXT flags, const char* layerPrefix, int32_t code, const char* message)
+{
+	if (!slots_)
+		return false;
+
+	// claim position, slot still holding unread message means ring is full
+	uint64_t position = writePosition_.load(std::memory_order_relaxed);
+	Slot* slot = nullptr;
+	for (;;) {
+		slot = &slots_[position & (CAPACITY - 1)];
+		uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+		int64_t difference = (int64_t)(sequence - position);
+
+		if (difference == 0) {
+			if (writePosition_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (difference < 0) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else {
+			position = writePosition_.load(std::memory_order_relaxed);
+		}
+	}
+
+	Message& out = slot->message;
+	out.severity = severity(flags);
+	out.code = code;
+	strncpy(out.prefix, layerPrefix ? layerPrefix : "", MAX_PREFIX - 1);
+	out.prefix[MAX_PREFIX - 1] = '\0';
+	strncpy(out.text, message ? message : "", MAX_MESSAGE - 1);
+	out.text[MAX_MESSAGE - 1] = '\0';
+
+	slot->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+DebugLog::Stats DebugLog::getStats() const
+{
+	Stats stats;
+	stats.messages = messages_.load(std::memory_order_relaxed);
+	stats.unique = unique_.load(std::memory_order_relaxed);
+	stats.dropped = dropped_.load(std::memory_order_relaxed);
+	for (uint32_t i = 0; i < SEVERITY_COUNT; ++i)
+		stats.severities[i] = severities_[i].load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+DebugLog::Severity DebugLog::severity(VkDebugReportFlagsEXT flags)
+{
+	if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT)
+		return SEVERITY_ERROR;
+	if (flags & VK_DEBUG_REPORT_WARNING_BIT_EXT)
+		return SEVERITY_WARNING;
+	if (flags & VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT)
+		return SEVERITY_PERFORMANCE;
+	if (flags & VK_DEBUG_REPORT_INFORMATION_BIT_EXT)
+		return SEVERITY_INFO;
+
+	return SEVERITY_DEBUG;
+}
+
+const char* DebugLog::severityName(Severity severity)
+{
+	switch (severity) {
+	case SEVERITY_DEBUG: return "debug";
+	case SEVERITY_INFO: return "info";
+	case SEVERITY_PERFORMANCE: return "performance";
+	case SEVERITY_WARNING: return "warning";
+	case SEVERITY_ERROR: return "error";
+	default: return "unknown";
+	}
+}
+
+// private functions
+void DebugLog::drainLoop()
+{
+	// producers don't signal, so drain polls; a few ms of delay is fine for a log
+	const auto pollInterval = std::chrono::milliseconds(5);
+	auto lastSummary = std::chrono::steady_clock::now();
+	Message message;
+
+	for (;;) {
+		bool stopping = false;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			stopping = wake_.wait_for(lock, pollInterval, [this] { return stop_; });
+		}
+
+		while (pop(message))
+			log(message);
+
+		auto now = std::chrono::steady_clock::now();
+		if (stopping || std::chrono::duration<double>(now - lastSummary).count() >= summaryInterval_) {
+			summarize();
+			lastSummary = now;
+		}
+
+		if (stopping)
+			break;
+	}
+
+	out_->flush();
+}
+
+bool DebugLog::pop(Message& message)
+{
+	Slot& slot = slots_[readPosition_ & (CAPACITY - 1)];
+	if (slot.sequence.load(std::memory_order_acquire) != readPosition_ + 1)
+		return false;
+
+	message = slot.message;
+
+	// hand slot back to producers one lap ahead
+	slot.sequence.store(readPosition_ + CAPACITY, std::memory_order_release);
+	++readPosition_;
+	return true;
+}
+
+void DebugLog::log(const Message& message)
+{
+	messages_.fetch_add(1, std::memory_order_relaxed);
+	severities_[message.severity].fetch_add(1, std::memory_order_relaxed);
+
+	// same text from same layer is the same problem, only first one is printed in full
+	std::string key = std::string(message.prefix) + '\n' + message.text;
+	auto it = entries_.find(key);
+	if (it != entries_.end()) {
+		++it->second.count;
+		return;
+	}
+
+	unique_.fetch_add(1, std::memory_order_relaxed);
+	if (entries_.size() < MAX_ENTRIES) {
+		Entry entry;
+		entry.severity = message.severity;
+		entry.prefix = message.prefix;
+		entry.count = 1;
+		entry.reported = 1;
+		entries_.emplace(std::move(key), std::move(entry));
+	}
+
+	*out_ << '[' << severityName(message.severity) << "] " << message.prefix << " (" << message.code << "): "
+		<< message.text << '\n';
+}
+
+void DebugLog::summarize()
+{
+	for (auto& it : entries_) {
+		Entry& entry = it.second;
+		if (entry.count == entry.reported)
+			continue;
+
+		// key is prefix, newline, text
+		*out_ << '[' << severityName(entry.severity) << "] repeated " << entry.count - entry.reported
+			<< " more times (" << entry.count << " total): " << it.first.substr(entry.prefix.size() + 1) << '\n';
+		entry.reported = entry.count;
+	}
+
+	uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+	if (dropped != reportedDropped_) {
+		*out_ << "[warning] debug log full, " << dropped - reportedDropped_ << " messages dropped\n";
+		reportedDropped_ = dropped;
+	}
+
+	out_->flush();
+}
@@ -0,0 +1,110 @@
+#ifndef DEBUGLOG_H_
+#define DEBUGLOG_H_
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <ostream>
+
+// Validation and debug report messages, logged off the thread that triggered them.
+// push() is called from inside driver calls on any thread: it claims a slot of a bounded
+// multi-producer ring with one CAS and copies the text in, never locking or allocating.
+// If ring is full message is dropped and counted. Drain thread prints each distinct
+// message once with its severity, repeats are summed up once per summary interval.
+class DebugLog {
+public:
+	enum Severity {
+		SEVERITY_DEBUG,
+		SEVERITY_INFO,
+		SEVERITY_PERFORMANCE,
+		SEVERITY_WARNING,
+		SEVERITY_ERROR,
+		SEVERITY_COUNT
+	};
+
+	struct Stats {
+		uint64_t messages = 0;					// drained so far, repeats included
+		uint64_t unique = 0;
+		uint64_t dropped = 0;					// ring was full
+		uint64_t severities[SEVERITY_COUNT] = { };
+	};
+
+	static const uint32_t CAPACITY = 1024;		// power of two
+	static const uint32_t MAX_PREFIX = 32;
+	static const uint32_t MAX_MESSAGE = 1024;	// longer text is cut
+	static const uint32_t MAX_ENTRIES = 4096;	// distinct messages counted, later ones are only printed
+
+private:
+	struct Message {
+		Severity severity;
+		int32_t code;
+		char prefix[MAX_PREFIX];
+		char text[MAX_MESSAGE];
+	};
+
+	// slot is free for producer at position p when sequence == p, readable when sequence == p + 1
+	struct Slot {
+		std::atomic<uint64_t> sequence;
+		Message message;
+	};
+
+	std::unique_ptr<Slot[]> slots_;
+	std::atomic<uint64_t> writePosition_{ 0 };
+	uint64_t readPosition_ = 0;					// drain thread only
+	std::atomic<uint64_t> dropped_{ 0 };
+
+	// drain thread, mutex only guards stop_ and is never held while draining or printing
+	std::thread drainer_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	bool stop_ = false;
+
+	struct Entry {
+		Severity severity;
+		std::string prefix;
+		uint64_t count = 0;
+		uint64_t reported = 0;					// count printed in last summary
+	};
+
+	std::unordered_map<std::string, Entry> entries_;
+
+	// written by drain thread, read by getStats() on any thread
+	std::atomic<uint64_t> messages_{ 0 };
+	std::atomic<uint64_t> unique_{ 0 };
+	std::atomic<uint64_t> severities_[SEVERITY_COUNT] = { };
+
+	uint64_t reportedDropped_ = 0;
+	std::ostream* out_ = nullptr;
+	double summaryInterval_ = 1.0;				// s
+
+private:
+	void drainLoop();
+	bool pop(Message&);
+	void log(const Message&);
+	void summarize();
+
+public:
+	DebugLog() = default;
+	DebugLog(const DebugLog&) = delete;
+	DebugLog& operator=(const DebugLog&) = delete;
+	~DebugLog() { stop(); }
+
+	void start(std::ostream& out, double summaryInterval = 1.0);
+	void stop();		// drains what is left and prints final repeat counts
+
+	// any thread, never blocks; false if message was dropped
+	bool push(VkDebugReportFlagsEXT, const char* layerPrefix, int32_t code, const char* message);
+
+	Stats getStats() const;		// never blocks
+	bool isStarted() const { return drainer_.joinable(); }
+
+	static Severity severity(VkDebugReportFlagsEXT);
+	static const char* severityName(Severity);
+};
+
+#endif // DEBUGLOG_H_
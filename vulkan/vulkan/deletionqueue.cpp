@@ -0,0 +1,30 @@
+#include "deletionqueue.h"
+
+void DeletionQueue::push(uint64_t frame, std::function<void()> destroy)
+{
+	Entry entry;
+	entry.frame = frame;
+	entry.destroy = std::move(destroy);
+	entries_.push_back(std::move(entry));
+}
+
+void DeletionQueue::collect(uint64_t frameNumber)
+{
+	for (auto it = entries_.begin(); it != entries_.end(); ) {
+		if (frameNumber < it->frame) {
+			++it;
+			continue;
+		}
+
+		it->destroy();
+		it = entries_.erase(it);
+	}
+}
+
+void DeletionQueue::flush()
+{
+	for (auto& entry : entries_)
+		entry.destroy();
+
+	entries_.clear();
+}
@@ -0,0 +1,29 @@
+#ifndef DELETIONQUEUE_H_
+#define DELETIONQUEUE_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Objects the gpu may still be using, destroyed once frame counter reaches the frame
+// given when they were retired. Used instead of vkDeviceWaitIdle whenever something is
+// replaced at runtime: swapchain on resize, pipelines on shader reload or format change.
+class DeletionQueue {
+	struct Entry {
+		uint64_t frame;					// safe to destroy from this frame on
+		std::function<void()> destroy;
+	};
+
+	std::deque<Entry> entries_;
+
+public:
+	void push(uint64_t frame, std::function<void()> destroy);
+
+	// entries are destroyed in order they were pushed
+	void collect(uint64_t frameNumber);
+	void flush();						// everything, device must be idle
+
+	size_t size() const { return entries_.size(); }
+};
+
+#endif // DELETIONQUEUE_H_
@@ -0,0 +1,146 @@
+#include "filewatcher.h"
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+static void addUnique(std::vector<std::string>& names, const std::string& name)
+{
+	if (std::find(names.begin(), names.end(), name) == names.end())
+		names.push_back(name);
+}
+
+#ifdef _WIN32
+
+void FileWatcher::init(const std::string& directory)
+{
+	destroy();
+
+	HANDLE notification = FindFirstChangeNotificationA(directory.c_str(), FALSE,
+		FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+	if (notification == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("failed to watch directory " + directory);
+
+	notification_ = notification;
+	directory_ = directory;
+
+	// notification doesn't say which file changed, so remember write times to compare with
+	scan(nullptr);
+}
+
+void FileWatcher::destroy()
+{
+	if (notification_)
+		FindCloseChangeNotification(notification_);
+
+	notification_ = nullptr;
+	writeTimes_.clear();
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+	std::vector<std::string> changed;
+
+	if (notification_ && WaitForSingleObject(notification_, 0) == WAIT_OBJECT_0) {
+		FindNextChangeNotification(notification_);
+		scan(&changed);
+	}
+
+	return changed;
+}
+
+bool FileWatcher::isWatching() const
+{
+	return notification_ != nullptr;
+}
+
+// private functions
+void FileWatcher::scan(std::vector<std::string>* changed)
+{
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((directory_ + "\\*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+
+	do {
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+
+		uint64_t writeTime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+		uint64_t& known = writeTimes_[data.cFileName];
+
+		if (changed && known != writeTime)
+			addUnique(*changed, data.cFileName);
+		known = writeTime;
+	} while (FindNextFileA(find, &data));
+
+	FindClose(find);
+}
+
+#else
+
+void FileWatcher::init(const std::string& directory)
+{
+	destroy();
+
+	fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd_ < 0)
+		throw std::runtime_error("failed to init inotify");
+
+	// close_write misses nothing written in place, moved_to catches editors that save through rename
+	watch_ = inotify_add_watch(fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (watch_ < 0) {
+		destroy();
+		throw std::runtime_error("failed to watch directory " + directory);
+	}
+
+	directory_ = directory;
+}
+
+void FileWatcher::destroy()
+{
+	if (fd_ >= 0)
+		close(fd_);
+
+	fd_ = -1;
+	watch_ = -1;
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+	std::vector<std::string> changed;
+	if (fd_ < 0)
+		return changed;
+
+	alignas(inotify_event) char buffer[4096];
+
+	for (;;) {
+		ssize_t length = read(fd_, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;			// EAGAIN - no more events
+
+		for (ssize_t offset = 0; offset < length; ) {
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			if (event->len && !(event->mask & IN_ISDIR))
+				addUnique(changed, event->name);
+
+			offset += sizeof(inotify_event) + event->len;
+		}
+	}
+
+	return changed;
+}
+
+bool FileWatcher::isWatching() const
+{
+	return fd_ >= 0;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef FILEWATCHER_H_
+#define FILEWATCHER_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+// Reports files written in one directory (not recursive). poll() never blocks,
+// so it can be called every frame. Uses inotify on linux and change notification
+// plus write time scan on windows.
+class FileWatcher {
+	std::string directory_;
+
+#ifdef _WIN32
+	void* notification_ = nullptr;
+	std::map<std::string, uint64_t> writeTimes_;
+
+	void scan(std::vector<std::string>* changed);
+#else
+	int fd_ = -1;
+	int watch_ = -1;
+#endif
+
+public:
+	FileWatcher() = default;
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+	~FileWatcher() { destroy(); }
+
+	void init(const std::string& directory);
+	void destroy();
+
+	// names (without directory) of files written since last call, each once
+	std::vector<std::string> poll();
+
+	bool isWatching() const;
+	const std::string& directory() const { return directory_; }
+};
+
+#endif // FILEWATCHER_H_
@@ -0,0 +1,59 @@
+#include "framepacer.h"
+#include <thread>
+#include <algorithm>
+
+const uint32_t FramePacer::WINDOW;
+constexpr double FramePacer::GAIN;
+constexpr double FramePacer::MAX_SLEEP;
+
+void FramePacer::init(bool enabled, double margin)
+{
+	enabled_ = enabled;
+	margin_ = margin;
+	reset();
+}
+
+void FramePacer::reset()
+{
+	sleep_ = 0.0;
+	blocked_ = 0.0;
+	history_.clear();
+}
+
+void FramePacer::pace()
+{
+	if (enabled_ && sleep_ > 0.0)
+		std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(sleep_));
+}
+
+void FramePacer::addBlocked(Clock::time_point callStart)
+{
+	blocked_ += std::chrono::duration<double, std::milli>(Clock::now() - callStart).count();
+}
+
+void FramePacer::endFrame()
+{
+	if (!enabled_)
+		return;
+
+	double blocked = blocked_;
+	blocked_ = 0.0;
+
+	// frame came close to waiting on nothing, sleep made it late or nearly late
+	if (blocked < margin_ * 0.5) {
+		sleep_ *= 0.5;
+		history_.clear();
+		return;
+	}
+
+	history_.push_back(blocked);
+	if (history_.size() > WINDOW)
+		history_.pop_front();
+
+	// only time every recent frame had spare can be slept away safely
+	if (history_.size() < WINDOW)
+		return;
+
+	double spare = *std::min_element(history_.begin(), history_.end()) - margin_;
+	sleep_ = std::min(std::max(sleep_ + spare * GAIN, 0.0), MAX_SLEEP);
+}
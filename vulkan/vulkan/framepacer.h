@@ -0,0 +1,40 @@
+#ifndef FRAMEPACER_H_
+#define FRAMEPACER_H_
+
+#include <cstdint>
+#include <chrono>
+#include <deque>
+
+// Moves idle time out of blocking calls (frame fence, acquire, present) into a sleep
+// in front of input sampling, so cpu work starts just before its result is needed.
+// Sleep grows while every recent frame still blocked longer than margin and is cut
+// as soon as one didn't, so it settles where blocking calls wait about margin.
+// Frames limited by cpu or gpu never block, pacer then never sleeps.
+class FramePacer {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	static const uint32_t WINDOW = 16;			// frames whose least blocked time decides next sleep
+	static constexpr double GAIN = 0.25;		// part of spare time taken per frame
+	static constexpr double MAX_SLEEP = 50.0;	// ms
+
+private:
+	bool enabled_ = false;
+	double margin_ = 1.0;			// ms
+	double sleep_ = 0.0;			// ms, slept by pace()
+	double blocked_ = 0.0;			// ms, blocking calls of current frame
+	std::deque<double> history_;	// blocked time of recent frames
+
+public:
+	void init(bool enabled, double margin = 1.0);
+	void reset();					// swapchain changed, cadence may be different
+
+	void pace();					// sleeps, call right before sampling input
+	void addBlocked(Clock::time_point callStart);
+	void endFrame();
+
+	bool isEnabled() const { return enabled_; }
+	double sleepTime() const { return sleep_; }
+};
+
+#endif // FRAMEPACER_H_
@@ -0,0 +1,383 @@
+#include "frametelemetry.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+const uint32_t Histogram::LINEAR_BUCKETS;
+const uint32_t Histogram::SUB_BUCKETS;
+const uint32_t Histogram::OCTAVES;
+const uint32_t FrameTelemetry::RING_SIZE;
+const uint32_t FrameTelemetry::MAX_REPORTED_HITCHES;
+constexpr double FrameTelemetry::HITCH_FACTOR;
+
+Histogram::Histogram()
+	: counts_(LINEAR_BUCKETS + OCTAVES * SUB_BUCKETS, 0)
+{
+}
+
+void Histogram::record(double milliseconds)
+{
+	uint64_t microseconds = milliseconds > 0.0 ? (uint64_t)(milliseconds * 1000.0) : 0;
+	++counts_[bucketIndex(microseconds)];
+	++total_;
+	max_ = std::max(max_, milliseconds);
+}
+
+void Histogram::reset()
+{
+	std::fill(counts_.begin(), counts_.end(), 0);
+	total_ = 0;
+	max_ = 0.0;
+}
+
+double Histogram::percentile(double fraction) const
+{
+	if (!total_)
+		return 0.0;
+
+	uint64_t target = std::max<uint64_t>(1, (uint64_t)std::ceil(fraction * total_));
+	uint64_t count = 0;
+
+	for (uint32_t i = 0; i < counts_.size(); ++i) {
+		count += counts_[i];
+		if (count >= target)
+			return std::min(bucketValue(i), max_);
+	}
+
+	return max_;
+}
+
+// private functions
+uint32_t Histogram::bucketIndex(uint64_t microseconds)
+{
+	if (microseconds < LINEAR_BUCKETS)
+		return (uint32_t)microseconds;
+
+	// shift leaves value in [32, 64), that's sub bucket inside octave
+	uint32_t shift = 0;
+	while ((microseconds >> shift) >= LINEAR_BUCKETS)
+		++shift;
+
+	if (shift > OCTAVES)
+		return LINEAR_BUCKETS + OCTAVES * SUB_BUCKETS - 1;
+
+	return LINEAR_BUCKETS + (shift - 1) * SUB_BUCKETS + (uint32_t)((microseconds >> shift) - SUB_BUCKETS);
+}
+
+double Histogram::bucketValue(uint32_t index)
+{
+	if (index < LINEAR_BUCKETS)
+		return (index + 1) / 1000.0;
+
+	uint32_t shift = (index - LINEAR_BUCKETS) / SUB_BUCKETS + 1;
+	uint64_t sub = (index - LINEAR_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+
+	return ((sub + 1) << shift) / 1000.0;
+}
+
+void FrameTelemetry::start(const std::string& path, double reportInterval, bool print)
+{
+	stop();
+
+	start_ = Clock::now();
+	started_ = true;
+	frameOpen_ = false;
+	frameNumber_ = 0;
+	ring_.assign(RING_SIZE, FrameRecord());
+	reportInterval_ = reportInterval;
+	windowStart_ = 0.0;
+	print_ = print;
+	resetTotals();
+
+	path_ = path;
+	json_ = path_.size() >= 5 && path_.compare(path_.size() - 5, 5, ".json") == 0;
+	firstRecord_ = true;
+	csvCounters_.clear();
+
+	if (!path_.empty()) {
+		file_.open(path_, std::ios::out | std::ios::trunc);
+		if (!file_.is_open())
+			std::cerr << "failed to open telemetry file " << path_ << std::endl;
+	}
+
+	stop_ = false;
+	exporter_ = std::thread(&FrameTelemetry::exportLoop, this);
+}
+
+void FrameTelemetry::stop()
+{
+	if (!exporter_.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	wake_.notify_all();
+	exporter_.join();
+
+	if (file_.is_open()) {
+		if (json_)
+			file_ << (firstRecord_ ? "[\n]\n" : "\n]\n");
+		file_.close();
+	}
+
+	started_ = false;
+}
+
+void FrameTelemetry::beginFrame()
+{
+	if (!started_)
+		return;
+
+	auto time = Clock::now();
+
+	if (frameOpen_)
+		finishFrame(std::chrono::duration<double, std::milli>(time - frameStart_).count());
+
+	current_ = FrameRecord();
+	current_.frameNumber = frameNumber_;
+	current_.time = std::chrono::duration<double>(time - start_).count();
+
+	frameStart_ = time;
+	phaseStart_ = time;
+	frameOpen_ = true;
+}
+
+void FrameTelemetry::mark(Phase phase)
+{
+	auto time = Clock::now();
+	current_.phases[phase] += std::chrono::duration<double, std::milli>(time - phaseStart_).count();
+	phaseStart_ = time;
+}
+
+bool FrameTelemetry::endFrame()
+{
+	if (started_ && !reportReady_ && now() - windowStart_ >= reportInterval_)
+		reportReady_ = true;
+
+	return reportReady_;
+}
+
+void FrameTelemetry::publish(const std::vector<std::pair<std::string, double>>& counters)
+{
+	if (!started_)
+		return;
+
+	Report report;
+	report.time = now();
+	report.duration = report.time - windowStart_;
+	report.frameCount = frameHistogram_.count();
+	report.frameTime = percentiles(frameHistogram_);
+	for (uint32_t i = 0; i < PHASE_COUNT; ++i)
+		report.phases[i] = percentiles(phaseHistograms_[i]);
+	report.hitches.swap(hitches_);
+	report.hitchCount = hitchCount_;
+	report.counters = counters;
+
+	frameHistogram_.reset();
+	for (auto& histogram : phaseHistograms_)
+		histogram.reset();
+	hitchCount_ = 0;
+	windowStart_ = report.time;
+	reportReady_ = false;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		queue_.push_back(std::move(report));
+	}
+	wake_.notify_one();
+}
+
+void FrameTelemetry::resetTotals()
+{
+	totalFrameHistogram_.reset();
+	for (auto& histogram : totalPhaseHistograms_)
+		histogram.reset();
+	totalHitchCount_ = 0;
+	totalStart_ = started_ ? now() : 0.0;
+}
+
+FrameTelemetry::Report FrameTelemetry::totals() const
+{
+	Report report;
+	report.time = started_ ? now() : 0.0;
+	report.duration = report.time - totalStart_;
+	report.frameCount = totalFrameHistogram_.count();
+	report.frameTime = percentiles(totalFrameHistogram_);
+	for (uint32_t i = 0; i < PHASE_COUNT; ++i)
+		report.phases[i] = percentiles(totalPhaseHistograms_[i]);
+	report.hitchCount = totalHitchCount_;
+
+	return report;
+}
+
+const char* FrameTelemetry::phaseName(Phase phase)
+{
+	static const char* names[PHASE_COUNT] = { "wait", "pacing", "update", "acquire", "record", "submit", "present" };
+
+	return phase < PHASE_COUNT ? names[phase] : "";
+}
+
+// private functions
+double FrameTelemetry::now() const
+{
+	return std::chrono::duration<double>(Clock::now() - start_).count();
+}
+
+void FrameTelemetry::finishFrame(double frameTime)
+{
+	current_.frameTime = frameTime;
+	ring_[current_.frameNumber % RING_SIZE] = current_;
+
+	frameHistogram_.record(frameTime);
+	totalFrameHistogram_.record(frameTime);
+	for (uint32_t i = 0; i < PHASE_COUNT; ++i) {
+		phaseHistograms_[i].record(current_.phases[i]);
+		totalPhaseHistograms_[i].record(current_.phases[i]);
+	}
+
+	// compared with average of earlier frames, so long stall doesn't hide itself
+	if (averageFrameTime_ > 0.0 && frameTime > HITCH_FACTOR * averageFrameTime_) {
+		++hitchCount_;
+		++totalHitchCount_;
+		if (hitches_.size() < MAX_REPORTED_HITCHES)
+			hitches_.push_back(current_);
+	}
+
+	averageFrameTime_ = averageFrameTime_ > 0.0 ? averageFrameTime_ * 0.95 + frameTime * 0.05 : frameTime;
+	++frameNumber_;
+}
+
+FrameTelemetry::Percentiles FrameTelemetry::percentiles(const Histogram& histogram)
+{
+	Percentiles result;
+	result.p50 = histogram.percentile(0.50);
+	result.p95 = histogram.percentile(0.95);
+	result.p99 = histogram.percentile(0.99);
+	result.max = histogram.max();
+
+	return result;
+}
+
+void FrameTelemetry::exportLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	for (;;) {
+		wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+
+		while (!queue_.empty()) {
+			Report report = std::move(queue_.front());
+			queue_.pop_front();
+
+			lock.unlock();
+			if (print_)
+				print(report);
+			if (file_.is_open())
+				write(report);
+			lock.lock();
+		}
+
+		if (stop_)
+			return;
+	}
+}
+
+void FrameTelemetry::print(const Report& report)
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2);
+
+	out << "\nFrames: " << report.frameCount << ", FPS: " << (report.duration > 0.0 ? report.frameCount / report.duration : 0.0)
+		<< "\nFrame time p50 " << report.frameTime.p50 << " ms, p95 " << report.frameTime.p95
+		<< " ms, p99 " << report.frameTime.p99 << " ms, max " << report.frameTime.max << " ms"
+		<< "\nPhases (p50/p99/max ms):";
+
+	for (uint32_t i = 0; i < PHASE_COUNT; ++i) {
+		const auto& phase = report.phases[i];
+		out << ' ' << phaseName((Phase)i) << ' ' << phase.p50 << '/' << phase.p99 << '/' << phase.max;
+	}
+
+	if (report.hitchCount) {
+		out << "\nHitches: " << report.hitchCount;
+		for (const auto& hitch : report.hitches) {
+			// name the phase that ate the time
+			uint32_t worst = (uint32_t)(std::max_element(hitch.phases, hitch.phases + PHASE_COUNT) - hitch.phases);
+			out << "\n  frame " << hitch.frameNumber << ": " << hitch.frameTime << " ms, "
+				<< phaseName((Phase)worst) << ' ' << hitch.phases[worst] << " ms";
+		}
+	}
+
+	for (const auto& counter : report.counters)
+		out << '\n' << counter.first << ": " << counter.second;
+
+	std::cout << out.str() << std::endl;
+}
+
+void FrameTelemetry::write(const Report& report)
+{
+	double fps = report.duration > 0.0 ? report.frameCount / report.duration : 0.0;
+
+	if (json_) {
+		file_ << (firstRecord_ ? "[\n" : ",\n");
+		file_ << "{\"time\":" << report.time << ",\"frames\":" << report.frameCount << ",\"fps\":" << fps
+			<< ",\"frameTime\":{\"p50\":" << report.frameTime.p50 << ",\"p95\":" << report.frameTime.p95
+			<< ",\"p99\":" << report.frameTime.p99 << ",\"max\":" << report.frameTime.max << "},\"phases\":{";
+
+		for (uint32_t i = 0; i < PHASE_COUNT; ++i) {
+			const auto& phase = report.phases[i];
+			file_ << (i ? "," : "") << '"' << phaseName((Phase)i) << "\":{\"p50\":" << phase.p50
+				<< ",\"p95\":" << phase.p95 << ",\"p99\":" << phase.p99 << ",\"max\":" << phase.max << '}';
+		}
+
+		file_ << "},\"hitchCount\":" << report.hitchCount << ",\"hitches\":[";
+		for (size_t i = 0; i < report.hitches.size(); ++i) {
+			file_ << (i ? "," : "") << "{\"frame\":" << report.hitches[i].frameNumber
+				<< ",\"frameTime\":" << report.hitches[i].frameTime << '}';
+		}
+
+		file_ << "],\"counters\":{";
+		for (size_t i = 0; i < report.counters.size(); ++i)
+			file_ << (i ? "," : "") << '"' << report.counters[i].first << "\":" << report.counters[i].second;
+		file_ << "}}";
+	}
+	else {
+		// columns are fixed by first report, counters missing later are left empty
+		if (firstRecord_) {
+			file_ << "time,frames,fps,frame_p50,frame_p95,frame_p99,frame_max";
+			for (uint32_t i = 0; i < PHASE_COUNT; ++i) {
+				std::string name = phaseName((Phase)i);
+				file_ << ',' << name << "_p50," << name << "_p99," << name << "_max";
+			}
+			file_ << ",hitches";
+			for (const auto& counter : report.counters) {
+				csvCounters_.push_back(counter.first);
+				file_ << ',' << counter.first;
+			}
+			file_ << '\n';
+		}
+
+		file_ << report.time << ',' << report.frameCount << ',' << fps << ',' << report.frameTime.p50 << ','
+			<< report.frameTime.p95 << ',' << report.frameTime.p99 << ',' << report.frameTime.max;
+		for (uint32_t i = 0; i < PHASE_COUNT; ++i)
+			file_ << ',' << report.phases[i].p50 << ',' << report.phases[i].p99 << ',' << report.phases[i].max;
+		file_ << ',' << report.hitchCount;
+
+		for (const auto& name : csvCounters_) {
+			file_ << ',';
+			for (const auto& counter : report.counters) {
+				if (counter.first == name) {
+					file_ << counter.second;
+					break;
+				}
+			}
+		}
+		file_ << '\n';
+	}
+
+	firstRecord_ = false;
+	file_.flush();
+}
@@ -0,0 +1,162 @@
+#ifndef FRAMETELEMETRY_H_
+#define FRAMETELEMETRY_H_
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <utility>
+
+// Log-linear histogram of durations (HDR style): 1 us steps below 64 us,
+// above that 32 buckets per power of two, so any value is off by less than 3.2%.
+class Histogram {
+	static const uint32_t LINEAR_BUCKETS = 64;
+	static const uint32_t SUB_BUCKETS = 32;
+	static const uint32_t OCTAVES = 26;				// up to ~35 minutes
+
+	std::vector<uint32_t> counts_;
+	uint64_t total_ = 0;
+	double max_ = 0.0;
+
+private:
+	static uint32_t bucketIndex(uint64_t microseconds);
+	static double bucketValue(uint32_t index);		// highest value of bucket, ms
+
+public:
+	Histogram();
+
+	void record(double milliseconds);
+	void reset();
+
+	double percentile(double fraction) const;		// ms, 0 if empty
+	double max() const { return max_; }
+	uint64_t count() const { return total_; }
+};
+
+// Per-frame cpu timing split in phases. Frame time is interval between beginFrame() calls,
+// mark() closes current phase. Once per report interval statistics of the window are
+// handed to background thread, which prints them and appends them to csv or json file,
+// so render loop never waits on console or disk.
+class FrameTelemetry {
+public:
+	enum Phase {
+		PHASE_WAIT,				// frame fence
+		PHASE_PACING,			// frame pacer sleep before input is sampled
+		PHASE_UPDATE,			// uploads and streamed data
+		PHASE_ACQUIRE,
+		PHASE_RECORD,
+		PHASE_SUBMIT,
+		PHASE_PRESENT,
+		PHASE_COUNT
+	};
+
+	struct FrameRecord {
+		uint64_t frameNumber = 0;
+		double time = 0.0;						// s since start
+		double frameTime = 0.0;					// ms
+		double phases[PHASE_COUNT] = { };		// ms
+	};
+
+	struct Percentiles {
+		double p50 = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+	};
+
+	struct Report {
+		double time = 0.0;						// s since start, end of window
+		double duration = 0.0;					// s
+		uint64_t frameCount = 0;
+		Percentiles frameTime;
+		Percentiles phases[PHASE_COUNT];
+		std::vector<FrameRecord> hitches;
+		uint32_t hitchCount = 0;
+		std::vector<std::pair<std::string, double>> counters;		// other subsystems' values
+	};
+
+	static const uint32_t RING_SIZE = 1024;
+	static const uint32_t MAX_REPORTED_HITCHES = 16;
+
+	// frame counts as hitch when it takes this many times longer than recent average
+	static constexpr double HITCH_FACTOR = 2.0;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point start_;
+	Clock::time_point frameStart_;
+	Clock::time_point phaseStart_;
+	bool started_ = false;
+	bool frameOpen_ = false;
+
+	std::vector<FrameRecord> ring_;				// last RING_SIZE frames
+	FrameRecord current_;
+	uint64_t frameNumber_ = 0;
+
+	Histogram frameHistogram_;
+	Histogram phaseHistograms_[PHASE_COUNT];
+	double averageFrameTime_ = 0.0;				// ema, baseline for hitch detection
+	std::vector<FrameRecord> hitches_;
+	uint32_t hitchCount_ = 0;
+
+	// whole run since resetTotals(), e.g. measured part of benchmark
+	Histogram totalFrameHistogram_;
+	Histogram totalPhaseHistograms_[PHASE_COUNT];
+	uint32_t totalHitchCount_ = 0;
+	double totalStart_ = 0.0;
+
+	double reportInterval_ = 1.0;				// s
+	double windowStart_ = 0.0;
+	bool reportReady_ = false;
+
+	// exporter thread
+	std::thread exporter_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::deque<Report> queue_;
+	bool stop_ = false;
+
+	std::string path_;
+	std::ofstream file_;
+	bool json_ = false;
+	bool firstRecord_ = true;
+	bool print_ = true;
+	std::vector<std::string> csvCounters_;
+
+private:
+	double now() const;
+	void finishFrame(double frameTime);
+	static Percentiles percentiles(const Histogram&);
+	void exportLoop();
+	void print(const Report&);
+	void write(const Report&);
+
+public:
+	FrameTelemetry() = default;
+	FrameTelemetry(const FrameTelemetry&) = delete;
+	FrameTelemetry& operator=(const FrameTelemetry&) = delete;
+	~FrameTelemetry() { stop(); }
+
+	// path may be empty (console only), *.json writes json array, anything else csv
+	void start(const std::string& path, double reportInterval = 1.0, bool print = true);
+	void stop();
+
+	void beginFrame();
+	void mark(Phase);
+
+	// returns true when report window is over, caller then passes its counters to publish()
+	bool endFrame();
+	void publish(const std::vector<std::pair<std::string, double>>& counters);
+
+	// statistics of all frames finished since resetTotals(), no hitch list
+	void resetTotals();
+	Report totals() const;
+
+	double windowTime() const { return now() - windowStart_; }		// s since last report
+	const FrameRecord& lastFrame() const { return ring_[(frameNumber_ + RING_SIZE - 1) % RING_SIZE]; }
+	static const char* phaseName(Phase);
+};
+
+#endif // FRAMETELEMETRY_H_
@@ -0,0 +1,252 @@
+#include "gpuculling.h"
+#include <stdexcept>
+#include <algorithm>
+
+const uint32_t GpuCulling::GROUP_SIZE;
+const VkDeviceSize GpuCulling::COMMANDS_OFFSET;
+
+void GpuCulling::init(VkDevice device, Allocator* allocator, VkShaderModule shader, VkPipelineCache pipelineCache,
+	uint32_t slotCount, DrawMode drawMode, uint32_t maxDrawIndirectCount)
+{
+	device_ = device;
+	allocator_ = allocator;
+	drawMode_ = drawMode;
+	maxDrawIndirectCount_ = std::max(maxDrawIndirectCount, 1u);
+
+	// extension command isn't exported by loader, it comes from device
+	if (drawMode_ == DRAW_COUNT) {
+		drawIndexedIndirectCount_ = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device_,
+			"vkCmdDrawIndexedIndirectCountKHR");
+		if (!drawIndexedIndirectCount_)
+			throw std::runtime_error("failed to get vkCmdDrawIndexedIndirectCountKHR");
+	}
+
+	createPipeline(shader, pipelineCache);
+	slots_.resize(slotCount);
+}
+
+void GpuCulling::destroy()
+{
+	if (!device_)
+		return;
+
+	for (auto& slot : slots_)
+		allocator_->destroyBuffer(slot.drawBuffer, slot.drawAllocation);
+	slots_.clear();
+
+	allocator_->destroyBuffer(objectBuffer_, objectAllocation_);
+	objectCount_ = 0;
+
+	if (descriptorPool_) {
+		vkDestroyDescriptorPool(device_, descriptorPool_, nullptr);
+		descriptorPool_ = VK_NULL_HANDLE;
+	}
+
+	if (pipeline_) {
+		vkDestroyPipeline(device_, pipeline_, nullptr);
+		pipeline_ = VK_NULL_HANDLE;
+	}
+
+	if (pipelineLayout_) {
+		vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
+		pipelineLayout_ = VK_NULL_HANDLE;
+	}
+
+	if (descriptorSetLayout_) {
+		vkDestroyDescriptorSetLayout(device_, descriptorSetLayout_, nullptr);
+		descriptorSetLayout_ = VK_NULL_HANDLE;
+	}
+
+	device_ = VK_NULL_HANDLE;
+}
+
+void GpuCulling::setObjects(UploadEngine& uploadEngine, const std::vector<InstanceData>& objects, uint32_t indexCount,
+	float meshRadius)
+{
+	if (objects.empty())
+		throw std::runtime_error("gpu culling has no objects");
+
+	objectCount_ = (uint32_t)objects.size();
+	indexCount_ = indexCount;
+	meshRadius_ = meshRadius;
+
+	VkBufferCreateInfo objectInfo = { };
+	objectInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	objectInfo.size = sizeof(InstanceData) * objects.size();
+	objectInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	objectInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	allocator_->createBuffer(objectInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, objectBuffer_, objectAllocation_);
+
+	// cull pass reads objects first, then vertex fetch
+	uploadEngine.uploadBuffer(objectBuffer_, 0, objects.data(), objectInfo.size,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+	VkBufferCreateInfo drawInfo = { };
+	drawInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	drawInfo.size = COMMANDS_OFFSET + sizeof(VkDrawIndexedIndirectCommand) * objects.size();
+	drawInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+	drawInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	for (auto& slot : slots_)
+		allocator_->createBuffer(drawInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.drawBuffer, slot.drawAllocation);
+
+	createDescriptorSets();
+}
+
+void GpuCulling::record(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+	const Slot& current = slots_[slot];
+
+	// packed records are appended with atomic counter, the rest overwrite every record
+	vkCmdFillBuffer(commandBuffer, current.drawBuffer, 0, COMMANDS_OFFSET, 0);
+
+	VkBufferMemoryBarrier clearBarrier = { };
+	clearBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	clearBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.buffer = current.drawBuffer;
+	clearBarrier.offset = 0;
+	clearBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 1, &clearBarrier, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1,
+		&current.descriptorSet, 0, nullptr);
+
+	CullConstants constants = { objectCount_, indexCount_, drawMode_ == DRAW_COUNT ? 1u : 0u, meshRadius_ };
+	vkCmdPushConstants(commandBuffer, pipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+	vkCmdDispatch(commandBuffer, (objectCount_ + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+	VkBufferMemoryBarrier drawBarrier = clearBarrier;
+	drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0, 0, nullptr, 1, &drawBarrier, 0, nullptr);
+}
+
+void GpuCulling::draw(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+	const Slot& current = slots_[slot];
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	switch (drawMode_) {
+	case DRAW_COUNT:
+		drawIndexedIndirectCount_(commandBuffer, current.drawBuffer, COMMANDS_OFFSET, current.drawBuffer, 0,
+			objectCount_, stride);
+		break;
+
+	case DRAW_MULTI:
+		for (uint32_t first = 0; first < objectCount_; first += maxDrawIndirectCount_) {
+			vkCmdDrawIndexedIndirect(commandBuffer, current.drawBuffer, COMMANDS_OFFSET + first * stride,
+				std::min(objectCount_ - first, maxDrawIndirectCount_), stride);
+		}
+		break;
+
+	case DRAW_SINGLE:
+		for (uint32_t i = 0; i < objectCount_; ++i)
+			vkCmdDrawIndexedIndirect(commandBuffer, current.drawBuffer, COMMANDS_OFFSET + i * stride, 1, stride);
+		break;
+	}
+}
+
+// private functions
+void GpuCulling::createPipeline(VkShaderModule shader, VkPipelineCache pipelineCache)
+{
+	VkDescriptorSetLayoutBinding bindings[2] = { };
+	for (uint32_t i = 0; i < 2; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutInfo = { };
+	setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutInfo.bindingCount = 2;
+	setLayoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(device_, &setLayoutInfo, nullptr, &descriptorSetLayout_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create cull descriptor set layout");
+
+	VkPushConstantRange pushConstantRange = { };
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(CullConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = { };
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout_;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create cull pipeline layout");
+
+	VkComputePipelineCreateInfo createInfo = { };
+	createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	createInfo.stage.module = shader;
+	createInfo.stage.pName = "main";
+	createInfo.layout = pipelineLayout_;
+	createInfo.basePipelineIndex = -1;
+
+	if (vkCreateComputePipelines(device_, pipelineCache, 1, &createInfo, nullptr, &pipeline_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create cull pipeline");
+}
+
+void GpuCulling::createDescriptorSets()
+{
+	VkDescriptorPoolSize poolSize = { };
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = 2 * (uint32_t)slots_.size();
+
+	VkDescriptorPoolCreateInfo poolInfo = { };
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = (uint32_t)slots_.size();
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (vkCreateDescriptorPool(device_, &poolInfo, nullptr, &descriptorPool_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create cull descriptor pool");
+
+	std::vector<VkDescriptorSetLayout> layouts(slots_.size(), descriptorSetLayout_);
+	std::vector<VkDescriptorSet> sets(slots_.size());
+
+	VkDescriptorSetAllocateInfo allocInfo = { };
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool_;
+	allocInfo.descriptorSetCount = (uint32_t)sets.size();
+	allocInfo.pSetLayouts = layouts.data();
+
+	if (vkAllocateDescriptorSets(device_, &allocInfo, sets.data()) != VK_SUCCESS)
+		throw std::runtime_error("failed to allocate cull descriptor sets");
+
+	for (size_t i = 0; i < slots_.size(); ++i) {
+		slots_[i].descriptorSet = sets[i];
+
+		VkDescriptorBufferInfo bufferInfos[] = {
+			{ objectBuffer_, 0, VK_WHOLE_SIZE },
+			{ slots_[i].drawBuffer, 0, VK_WHOLE_SIZE }
+		};
+
+		VkWriteDescriptorSet write = { };
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = sets[i];
+		write.dstBinding = 0;
+		write.descriptorCount = 2;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = bufferInfos;
+
+		vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+	}
+}
@@ -0,0 +1,91 @@
+#ifndef GPUCULLING_H_
+#define GPUCULLING_H_
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include "allocator.h"
+#include "uploadengine.h"
+#include "vertexformat.h"
+
+// Visibility decided and draws written on gpu. Objects are instances of one mesh; cull pass
+// tests bounding circle of every object against clip space and writes VkDrawIndexedIndirectCommand
+// records that draw visible objects through firstInstance, render pass then consumes them with
+// indirect draws. Cpu records the same few commands whatever the object count.
+// Records of every frame slot have own buffer, so cull of a frame never races draws of another.
+class GpuCulling {
+public:
+	// how records reach the draw, best one the device supports is picked by caller
+	enum DrawMode {
+		DRAW_COUNT,			// visible records packed, gpu reads their count (VK_KHR_draw_indirect_count)
+		DRAW_MULTI,			// record per object, culled ones draw no instances (multiDrawIndirect)
+		DRAW_SINGLE,		// same records, one indirect draw each
+	};
+
+private:
+	struct Slot {
+		VkBuffer drawBuffer = VK_NULL_HANDLE;		// count, padding, records
+		Allocation drawAllocation;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	};
+
+	struct CullConstants {
+		uint32_t objectCount;
+		uint32_t indexCount;
+		uint32_t compact;
+		float meshRadius;
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	Allocator* allocator_ = nullptr;
+
+	VkDescriptorSetLayout descriptorSetLayout_ = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+	VkPipeline pipeline_ = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+
+	// read by cull pass and as instance attributes
+	VkBuffer objectBuffer_ = VK_NULL_HANDLE;
+	Allocation objectAllocation_;
+
+	std::vector<Slot> slots_;
+	uint32_t objectCount_ = 0;
+	uint32_t indexCount_ = 0;
+	float meshRadius_ = 0.0f;
+
+	DrawMode drawMode_ = DRAW_SINGLE;
+	uint32_t maxDrawIndirectCount_ = 1;
+	PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount_ = nullptr;
+
+	static const uint32_t GROUP_SIZE = 64;			// local_size_x of cull.comp
+	static const VkDeviceSize COMMANDS_OFFSET = 16;	// records follow count and padding
+
+private:
+	void createPipeline(VkShaderModule, VkPipelineCache);
+	void createDescriptorSets();
+
+public:
+	GpuCulling() = default;
+	GpuCulling(const GpuCulling&) = delete;
+	GpuCulling& operator=(const GpuCulling&) = delete;
+	~GpuCulling() { destroy(); }
+
+	// DRAW_COUNT needs the extension and multiDrawIndirect feature on device, and all objects within
+	// maxDrawIndirectCount; DRAW_MULTI the multiDrawIndirect feature
+	void init(VkDevice, Allocator*, VkShaderModule, VkPipelineCache, uint32_t slotCount,
+		DrawMode, uint32_t maxDrawIndirectCount);
+	void destroy();		// device must be idle
+
+	// object buffer is uploaded with next upload batch; mesh is drawn with indices from 0
+	void setObjects(UploadEngine&, const std::vector<InstanceData>&, uint32_t indexCount, float meshRadius);
+
+	// cull pass, recorded outside render pass
+	void record(VkCommandBuffer, uint32_t slot);
+	// draws written by record() for the same slot, recorded inside render pass
+	void draw(VkCommandBuffer, uint32_t slot);
+
+	VkBuffer objectBuffer() const { return objectBuffer_; }
+	uint32_t objectCount() const { return objectCount_; }
+	DrawMode drawMode() const { return drawMode_; }
+};
+
+#endif // GPUCULLING_H_
@@ -0,0 +1,230 @@
+#include "gpuprofiler.h"
+#include <stdexcept>
+
+const uint32_t GpuProfiler::STATISTIC_COUNT;
+const uint32_t GpuProfiler::MAX_SCOPES;
+const uint32_t GpuProfiler::HISTORY_SIZE;
+const uint32_t GpuProfiler::INVALID_SCOPE;
+
+void GpuProfiler::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t frameCount, bool statistics)
+{
+	device_ = device;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	timestampPeriod_ = properties.limits.timestampPeriod;
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> familyProperties(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, familyProperties.data());
+
+	// queue without valid timestamp bits can't be profiled at all
+	uint32_t validBits = queueFamily < familyCount ? familyProperties[queueFamily].timestampValidBits : 0;
+	supported_ = validBits > 0;
+	statisticsSupported_ = supported_ && statistics;
+	timestampMask_ = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	if (!supported_)
+		return;
+
+	frames_.resize(frameCount);
+	for (auto& frame : frames_) {
+		VkQueryPoolCreateInfo createInfo = { };
+		createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		createInfo.queryCount = MAX_SCOPES * 2;
+
+		if (vkCreateQueryPool(device_, &createInfo, nullptr, &frame.timestampPool) != VK_SUCCESS)
+			throw std::runtime_error("failed to create timestamp query pool");
+
+		if (statisticsSupported_) {
+			createInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			createInfo.queryCount = MAX_SCOPES;
+			createInfo.pipelineStatistics = statisticsFlags();
+
+			if (vkCreateQueryPool(device_, &createInfo, nullptr, &frame.statisticsPool) != VK_SUCCESS)
+				throw std::runtime_error("failed to create pipeline statistics query pool");
+		}
+	}
+}
+
+void GpuProfiler::destroy()
+{
+	for (auto& frame : frames_) {
+		if (frame.timestampPool)
+			vkDestroyQueryPool(device_, frame.timestampPool, nullptr);
+
+		if (frame.statisticsPool)
+			vkDestroyQueryPool(device_, frame.statisticsPool, nullptr);
+	}
+
+	frames_.clear();
+	current_ = nullptr;
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	if (!supported_)
+		return;
+
+	current_ = &frames_[frameIndex % frames_.size()];
+	collect(*current_);
+
+	current_->records.clear();
+	current_->timestampCount = 0;
+	current_->statisticsCount = 0;
+	statisticsActive_ = false;
+
+	vkCmdResetQueryPool(commandBuffer, current_->timestampPool, 0, MAX_SCOPES * 2);
+	if (current_->statisticsPool)
+		vkCmdResetQueryPool(commandBuffer, current_->statisticsPool, 0, MAX_SCOPES);
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char* name, bool statistics)
+{
+	if (!current_ || current_->records.size() >= MAX_SCOPES)
+		return INVALID_SCOPE;
+
+	Record record;
+	record.scope = getScope(name);
+	record.timestampQuery = current_->timestampCount;
+	current_->timestampCount += 2;
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, current_->timestampPool, record.timestampQuery);
+
+	if (statistics && statisticsSupported_ && !statisticsActive_) {
+		record.statisticsQuery = (int32_t)current_->statisticsCount++;
+		statisticsActive_ = true;
+
+		vkCmdBeginQuery(commandBuffer, current_->statisticsPool, record.statisticsQuery, 0);
+	}
+
+	current_->records.push_back(record);
+
+	return (uint32_t)current_->records.size() - 1;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope)
+{
+	if (!current_ || scope >= current_->records.size())
+		return;
+
+	const auto& record = current_->records[scope];
+
+	if (record.statisticsQuery >= 0) {
+		vkCmdEndQuery(commandBuffer, current_->statisticsPool, record.statisticsQuery);
+		statisticsActive_ = false;
+	}
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, current_->timestampPool, record.timestampQuery + 1);
+}
+
+std::vector<GpuProfiler::ScopeStats> GpuProfiler::getStats() const
+{
+	std::vector<ScopeStats> stats;
+
+	for (const auto& scope : scopes_) {
+		if (scope.history.empty())
+			continue;
+
+		ScopeStats scopeStats;
+		scopeStats.name = scope.name;
+		scopeStats.lastTime = scope.history[(scope.next + scope.history.size() - 1) % scope.history.size()].time;
+
+		uint32_t statisticsSamples = 0;
+		for (const auto& sample : scope.history) {
+			scopeStats.averageTime += sample.time;
+
+			if (sample.hasStatistics) {
+				for (uint32_t i = 0; i < STATISTIC_COUNT; ++i)
+					scopeStats.statistics[i] += (double)sample.statistics[i];
+				++statisticsSamples;
+			}
+		}
+
+		scopeStats.averageTime /= scope.history.size();
+		scopeStats.hasStatistics = statisticsSamples > 0;
+		for (uint32_t i = 0; statisticsSamples && i < STATISTIC_COUNT; ++i)
+			scopeStats.statistics[i] /= statisticsSamples;
+
+		stats.push_back(scopeStats);
+	}
+
+	return stats;
+}
+
+VkQueryPipelineStatisticFlags GpuProfiler::statisticsFlags() const
+{
+	if (!statisticsSupported_)
+		return 0;
+
+	// bit order matches order of results and statisticName()
+	return VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+}
+
+const char* GpuProfiler::statisticName(uint32_t index)
+{
+	static const char* names[STATISTIC_COUNT] = {
+		"vertices", "primitives", "vertex invocations", "clipped primitives", "fragment invocations"
+	};
+
+	return index < STATISTIC_COUNT ? names[index] : "";
+}
+
+// private functions
+void GpuProfiler::collect(FrameQueries& frame)
+{
+	if (frame.records.empty())
+		return;
+
+	// fence of this frame slot was waited on, so results are ready and no wait bit is needed
+	std::vector<uint64_t> timestamps(frame.timestampCount);
+	if (vkGetQueryPoolResults(device_, frame.timestampPool, 0, frame.timestampCount,
+		timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+		return;
+
+	std::vector<uint64_t> statistics(frame.statisticsCount * STATISTIC_COUNT);
+	bool statisticsValid = frame.statisticsCount > 0 &&
+		vkGetQueryPoolResults(device_, frame.statisticsPool, 0, frame.statisticsCount,
+			statistics.size() * sizeof(uint64_t), statistics.data(), STATISTIC_COUNT * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+
+	for (const auto& record : frame.records) {
+		Sample sample;
+
+		uint64_t ticks = (timestamps[record.timestampQuery + 1] - timestamps[record.timestampQuery]) & timestampMask_;
+		sample.time = ticks * timestampPeriod_ / 1000000.0;
+
+		if (record.statisticsQuery >= 0 && statisticsValid) {
+			sample.hasStatistics = true;
+			for (uint32_t i = 0; i < STATISTIC_COUNT; ++i)
+				sample.statistics[i] = statistics[record.statisticsQuery * STATISTIC_COUNT + i];
+		}
+
+		auto& scope = scopes_[record.scope];
+		if (scope.history.size() < HISTORY_SIZE)
+			scope.history.push_back(sample);
+		else
+			scope.history[scope.next] = sample;
+		scope.next = (scope.next + 1) % HISTORY_SIZE;
+	}
+}
+
+uint32_t GpuProfiler::getScope(const char* name)
+{
+	auto it = scopeIndices_.find(name);
+	if (it != scopeIndices_.end())
+		return it->second;
+
+	Scope scope;
+	scope.name = name;
+	scopes_.push_back(scope);
+	scopeIndices_[name] = (uint32_t)scopes_.size() - 1;
+
+	return (uint32_t)scopes_.size() - 1;
+}
@@ -0,0 +1,91 @@
+#ifndef GPUPROFILER_H_
+#define GPUPROFILER_H_
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+// Measures gpu time of named scopes with timestamp queries and optionally counts
+// pipeline statistics for them. Every frame in flight has its own query pools,
+// they are read back when frame slot comes around again, so results never stall cpu.
+// All functions are called from render thread, scopes are recorded in primary command buffer.
+class GpuProfiler {
+public:
+	static const uint32_t STATISTIC_COUNT = 5;
+	static const uint32_t MAX_SCOPES = 64;			// per frame
+	static const uint32_t HISTORY_SIZE = 64;		// frames in rolling average
+	static const uint32_t INVALID_SCOPE = ~0u;
+
+	struct ScopeStats {
+		std::string name;
+		double lastTime = 0.0;			// ms
+		double averageTime = 0.0;		// ms
+		bool hasStatistics = false;
+		double statistics[STATISTIC_COUNT] = { };		// averages, in statisticName() order
+	};
+
+private:
+	struct Sample {
+		double time = 0.0;
+		bool hasStatistics = false;
+		uint64_t statistics[STATISTIC_COUNT] = { };
+	};
+
+	struct Scope {
+		std::string name;
+		std::vector<Sample> history;		// ring of last HISTORY_SIZE samples
+		size_t next = 0;
+	};
+
+	struct Record {
+		uint32_t scope = 0;
+		uint32_t timestampQuery = 0;		// begin, end is the next one
+		int32_t statisticsQuery = -1;
+	};
+
+	struct FrameQueries {
+		VkQueryPool timestampPool = VK_NULL_HANDLE;
+		VkQueryPool statisticsPool = VK_NULL_HANDLE;
+		std::vector<Record> records;
+		uint32_t timestampCount = 0;
+		uint32_t statisticsCount = 0;
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	bool supported_ = false;
+	bool statisticsSupported_ = false;
+	double timestampPeriod_ = 1.0;			// ns per tick
+	uint64_t timestampMask_ = ~0ull;
+
+	std::vector<FrameQueries> frames_;
+	FrameQueries* current_ = nullptr;
+	bool statisticsActive_ = false;			// queries of same type can't nest
+
+	std::vector<Scope> scopes_;
+	std::unordered_map<std::string, uint32_t> scopeIndices_;
+
+private:
+	void collect(FrameQueries&);
+	uint32_t getScope(const char* name);
+
+public:
+	// statistics need pipelineStatisticsQuery feature enabled on device
+	void init(VkPhysicalDevice, VkDevice, uint32_t queueFamily, uint32_t frameCount, bool statistics);
+	void destroy();
+
+	// read results of frame slot recorded frameCount frames ago and reset its queries,
+	// must be recorded outside of render pass
+	void beginFrame(VkCommandBuffer, uint32_t frameIndex);
+
+	uint32_t beginScope(VkCommandBuffer, const char* name, bool statistics = false);
+	void endScope(VkCommandBuffer, uint32_t scope);
+
+	std::vector<ScopeStats> getStats() const;
+
+	bool isSupported() const { return supported_; }
+	VkQueryPipelineStatisticFlags statisticsFlags() const;
+	static const char* statisticName(uint32_t index);
+};
+
+#endif // GPUPROFILER_H_
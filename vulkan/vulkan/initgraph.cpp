@@ -0,0 +1,98 @@
+#include "initgraph.h"
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+size_t InitGraph::add(const char* name, const std::vector<size_t>& dependencies, Task task)
+{
+	size_t index = nodes_.size();
+
+	for (auto dependency : dependencies) {
+		if (dependency >= index)
+			throw std::runtime_error("init step depends on step added after it");
+	}
+
+	Node node;
+	node.name = name;
+	node.task = std::move(task);
+	node.waitCount = (uint32_t)dependencies.size();
+	nodes_.push_back(std::move(node));
+
+	for (auto dependency : dependencies)
+		nodes_[dependency].dependents.push_back(index);
+
+	return index;
+}
+
+void InitGraph::run(StartupTrace* trace)
+{
+	std::mutex mutex;
+	std::condition_variable finished;
+	std::vector<size_t> ready;
+	std::vector<std::thread> threads;
+	std::exception_ptr error;
+	size_t running = 0;
+
+	for (size_t i = 0; i < nodes_.size(); ++i) {
+		if (!nodes_[i].waitCount)
+			ready.push_back(i);
+	}
+
+	// node fields other than waitCount are only read while graph runs
+	auto execute = [&](size_t index) {
+		std::exception_ptr taskError;
+		try {
+			StartupTrace::Scope span(trace, nodes_[index].name);
+			nodes_[index].task();
+		}
+		catch (...) {
+			taskError = std::current_exception();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (taskError) {
+			if (!error)
+				error = taskError;
+		}
+		else {
+			for (auto dependent : nodes_[index].dependents) {
+				if (--nodes_[dependent].waitCount == 0)
+					ready.push_back(dependent);
+			}
+		}
+
+		--running;
+		finished.notify_all();
+	};
+
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		while (!ready.empty() && !error) {
+			size_t index = ready.back();
+			ready.pop_back();
+
+			try {
+				threads.emplace_back(execute, index);
+				++running;
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+		}
+
+		if (!running)
+			break;
+
+		finished.wait(lock, [&] { return !running || (!ready.empty() && !error); });
+	}
+	lock.unlock();
+
+	for (auto& thread : threads)
+		thread.join();
+	nodes_.clear();
+
+	if (error)
+		std::rethrow_exception(error);
+}
@@ -0,0 +1,35 @@
+#ifndef INITGRAPH_H_
+#define INITGRAPH_H_
+
+#include <vector>
+#include <functional>
+#include "startuptrace.h"
+
+// Startup steps with dependencies between them. run() starts every step on its own thread
+// as soon as steps it depends on are done, so independent work (file reads, shader modules,
+// swapchain) overlaps instead of queueing. Meant for one-off init: a step must be safe to run
+// alongside any step it doesn't depend on.
+class InitGraph {
+public:
+	typedef std::function<void()> Task;
+
+private:
+	struct Node {
+		const char* name = nullptr;
+		Task task;
+		std::vector<size_t> dependents;
+		uint32_t waitCount = 0;			// unfinished dependencies
+	};
+
+	std::vector<Node> nodes_;
+
+public:
+	// dependencies are ids returned by earlier add() calls, so graph never has cycles
+	size_t add(const char* name, const std::vector<size_t>& dependencies, Task task);
+
+	// blocks until every step finished, each step is a span of trace (may be null);
+	// after first failure no new steps start, running ones are waited for and exception is rethrown
+	void run(StartupTrace* trace);
+};
+
+#endif // INITGRAPH_H_
@@ -0,0 +1,98 @@
+#include "mappedfile.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+void MappedFile::open(const std::string& path)
+{
+	close();
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("failed to open file " + path);
+
+	LARGE_INTEGER fileSize = { };
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		throw std::runtime_error("failed to map empty file " + path);
+	}
+
+	// view keeps mapping alive, both handles can be closed right away
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping)
+		throw std::runtime_error("failed to map file " + path);
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!view)
+		throw std::runtime_error("failed to map file " + path);
+
+	data_ = static_cast<const uint8_t*>(view);
+	size_ = (size_t)fileSize.QuadPart;
+}
+
+void MappedFile::close()
+{
+	if (data_)
+		UnmapViewOfFile(data_);
+
+	data_ = nullptr;
+	size_ = 0;
+}
+
+#else
+
+void MappedFile::open(const std::string& path)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("failed to open file " + path);
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		::close(fd);
+		throw std::runtime_error("failed to map empty file " + path);
+	}
+
+	// mapping holds its own reference to file
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED)
+		throw std::runtime_error("failed to map file " + path);
+
+	madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+	data_ = static_cast<const uint8_t*>(view);
+	size_ = (size_t)info.st_size;
+}
+
+void MappedFile::close()
+{
+	if (data_)
+		munmap(const_cast<uint8_t*>(data_), size_);
+
+	data_ = nullptr;
+	size_ = 0;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Read only view of whole file mapped into address space. Pages are read by the os
+// on first touch, so data goes from page cache to its destination without a copy
+// into process buffers. Mapping is hinted for sequential access.
+class MappedFile {
+	const uint8_t* data_ = nullptr;
+	size_t size_ = 0;
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	void open(const std::string& path);
+	void close();
+
+	const uint8_t* data() const { return data_; }
+	size_t size() const { return size_; }
+	bool isOpen() const { return data_ != nullptr; }
+};
+
+#endif // MAPPEDFILE_H_
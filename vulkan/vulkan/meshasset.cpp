@@ -0,0 +1,164 @@
+#include "meshasset.h"
+#include <stdexcept>
+#include <fstream>
+#include <cstring>
+
+const uint32_t MeshAsset::MAGIC;
+const uint32_t MeshAsset::VERSION;
+const uint64_t MeshAsset::SECTION_ALIGNMENT;
+
+void MeshAsset::load(const std::string& path, bool verify)
+{
+	close();
+	file_.open(path);
+
+	if (file_.size() < sizeof(MeshHeader))
+		throw std::runtime_error("mesh file is truncated: " + path);
+
+	memcpy(&header_, file_.data(), sizeof(MeshHeader));
+	const MeshHeader& h = header_;
+
+	if (h.magic != MAGIC || h.version != VERSION)
+		throw std::runtime_error("not a baked mesh or unsupported version: " + path);
+
+	if (h.vertexFormat != VERTEX_FLOAT && h.vertexFormat != VERTEX_COMPACT)
+		throw std::runtime_error("mesh file has unknown vertex format: " + path);
+
+	if (h.indexBits != 0 && h.indexBits != 16 && h.indexBits != 32)
+		throw std::runtime_error("mesh file has unknown index size: " + path);
+
+	if (h.vertexCount == 0 || (h.indexBits && h.indexCount == 0))
+		throw std::runtime_error("mesh file has no geometry: " + path);
+
+	uint64_t stride = h.vertexFormat == VERTEX_COMPACT ? sizeof(CompactVertex) : sizeof(Vertex);
+	if (h.vertexSize != stride * h.vertexCount || h.indexSize != (uint64_t)h.indexBits / 8 * h.indexCount)
+		throw std::runtime_error("mesh file sections don't match element counts: " + path);
+
+	// sizes are at most 32 bit count times 32 bytes, so only offsets can overflow
+	uint64_t fileSize = file_.size();
+	if (h.vertexOffset % SECTION_ALIGNMENT || h.indexOffset % SECTION_ALIGNMENT ||
+		h.vertexOffset > fileSize || h.vertexSize > fileSize - h.vertexOffset ||
+		h.indexOffset > fileSize || h.indexSize > fileSize - h.indexOffset)
+		throw std::runtime_error("mesh file is truncated: " + path);
+
+	if (verify) {
+		uint64_t hash = checksum(vertexData(), h.vertexSize);
+		hash = checksum(indexData(), h.indexSize, hash);
+
+		if (hash != h.checksum)
+			throw std::runtime_error("mesh file checksum mismatch: " + path);
+	}
+}
+
+void MeshAsset::close()
+{
+	file_.close();
+	header_ = { };
+}
+
+static uint64_t alignSection(uint64_t position)
+{
+	return (position + MeshAsset::SECTION_ALIGNMENT - 1) / MeshAsset::SECTION_ALIGNMENT * MeshAsset::SECTION_ALIGNMENT;
+}
+
+static void writePadding(std::ofstream& file, uint64_t& position)
+{
+	static const char zeros[MeshAsset::SECTION_ALIGNMENT] = { };
+
+	file.write(zeros, (std::streamsize)(alignSection(position) - position));
+	position = alignSection(position);
+}
+
+template<class T>
+static void writeSection(std::ofstream& file, uint64_t& position, const std::vector<T>& data)
+{
+	file.write(reinterpret_cast<const char*>(data.data()), (std::streamsize)(sizeof(T) * data.size()));
+	position += sizeof(T) * data.size();
+}
+
+void MeshAsset::bake(const std::string& path, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	bool compactVertices, uint32_t indexBits)
+{
+	if (indexBits != 0 && indexBits != 16 && indexBits != 32)
+		throw std::runtime_error("index size must be 16 or 32 bits");
+
+	if (indexBits == 16 && vertices.size() > 65536)
+		throw std::runtime_error("mesh has too many vertices for 16 bit indices");
+
+	for (uint32_t index : indices) {
+		if (index >= vertices.size())
+			throw std::runtime_error("mesh index out of vertex range");
+	}
+
+	// conversion happens here once, loader never touches the data
+	std::vector<CompactVertex> packed;
+	if (compactVertices) {
+		packed.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+			packed[i] = packVertex(vertices[i]);
+	}
+
+	std::vector<uint16_t> shortIndices;
+	if (indexBits == 16)
+		shortIndices.assign(indices.begin(), indices.end());
+
+	MeshHeader header = { };
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.vertexFormat = compactVertices ? VERTEX_COMPACT : VERTEX_FLOAT;
+	header.indexBits = indexBits;
+	header.vertexCount = (uint32_t)vertices.size();
+	header.indexCount = indexBits ? (uint32_t)indices.size() : 0;
+	header.vertexSize = (compactVertices ? sizeof(CompactVertex) : sizeof(Vertex)) * (uint64_t)vertices.size();
+	header.indexSize = (uint64_t)indexBits / 8 * header.indexCount;
+	header.vertexOffset = alignSection(sizeof(MeshHeader));
+	header.indexOffset = indexBits ? alignSection(header.vertexOffset + header.vertexSize) : 0;
+
+	const void* vertexData = compactVertices ? (const void*)packed.data() : (const void*)vertices.data();
+	const void* indexData = indexBits == 16 ? (const void*)shortIndices.data() : (const void*)indices.data();
+	header.checksum = checksum(indexData, header.indexSize, checksum(vertexData, header.vertexSize));
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		throw std::runtime_error("failed to create mesh file " + path);
+
+	uint64_t position = 0;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	position += sizeof(header);
+
+	writePadding(file, position);
+	if (compactVertices)
+		writeSection(file, position, packed);
+	else
+		writeSection(file, position, vertices);
+
+	if (indexBits) {
+		writePadding(file, position);
+		if (indexBits == 16)
+			writeSection(file, position, shortIndices);
+		else
+			writeSection(file, position, indices);
+	}
+
+	if (!file)
+		throw std::runtime_error("failed to write mesh file " + path);
+}
+
+uint64_t MeshAsset::checksum(const void* data, uint64_t size, uint64_t hash)
+{
+	// fnv-1a over 64 bit words instead of bytes, keeps up with disk reads
+	const uint64_t prime = 0x100000001b3ull;
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	uint64_t wordCount = size / sizeof(uint64_t);
+	for (uint64_t i = 0; i < wordCount; ++i) {
+		uint64_t word;
+		memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(word));
+		hash = (hash ^ word) * prime;
+	}
+
+	for (uint64_t i = wordCount * sizeof(uint64_t); i < size; ++i)
+		hash = (hash ^ bytes[i]) * prime;
+
+	return hash;
+}
@@ -0,0 +1,68 @@
+#ifndef MESHASSET_H_
+#define MESHASSET_H_
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "mappedfile.h"
+#include "vertexformat.h"
+
+// Baked mesh file: header, then vertex and index sections already in the layout
+// gpu reads, each starting at multiple of SECTION_ALIGNMENT. Loading maps the file
+// and hands out pointers into the mapping, so upload copies straight to staging
+// memory with nothing parsed or converted on the way.
+struct MeshHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexFormat;		// MeshAsset::VERTEX_FLOAT or VERTEX_COMPACT
+	uint32_t indexBits;			// 16 or 32, 0 - no index section
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint64_t vertexOffset;		// from file start
+	uint64_t vertexSize;
+	uint64_t indexOffset;
+	uint64_t indexSize;
+	uint64_t checksum;			// of both sections
+};
+
+static_assert(sizeof(MeshHeader) == 64, "mesh header layout is part of file format");
+
+class MeshAsset {
+	MappedFile file_;
+	MeshHeader header_ = { };
+
+public:
+	static const uint32_t MAGIC = 0x4853454d;		// "MESH" in little endian
+	static const uint32_t VERSION = 1;
+	static const uint64_t SECTION_ALIGNMENT = 256;
+
+	enum VertexFormat : uint32_t {
+		VERTEX_FLOAT = 0,		// Vertex
+		VERTEX_COMPACT = 1,		// CompactVertex
+	};
+
+public:
+	// throws if file is truncated, has unknown format or (with verify) wrong checksum
+	void load(const std::string& path, bool verify = true);
+	void close();
+
+	bool isLoaded() const { return file_.isOpen(); }
+	bool compactVertices() const { return header_.vertexFormat == VERTEX_COMPACT; }
+	uint32_t indexBits() const { return header_.indexBits; }
+	uint32_t vertexCount() const { return header_.vertexCount; }
+	uint32_t indexCount() const { return header_.indexCount; }
+
+	// valid until close()
+	const void* vertexData() const { return file_.data() + header_.vertexOffset; }
+	uint64_t vertexDataSize() const { return header_.vertexSize; }
+	const void* indexData() const { return file_.data() + header_.indexOffset; }
+	uint64_t indexDataSize() const { return header_.indexSize; }
+
+	// convert mesh to gpu layout and write it as baked file, indexBits 0 drops indices
+	static void bake(const std::string& path, const std::vector<Vertex>&, const std::vector<uint32_t>& indices,
+		bool compactVertices, uint32_t indexBits);
+
+	static uint64_t checksum(const void* data, uint64_t size, uint64_t hash = 0xcbf29ce484222325ull);
+};
+
+#endif // MESHASSET_H_
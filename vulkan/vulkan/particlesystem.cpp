@@ -0,0 +1,284 @@
+#include "particlesystem.h"
+#include "vertexformat.h"
+#include <stdexcept>
+#include <algorithm>
+
+const uint32_t ParticleSystem::GROUP_SIZE;
+const float ParticleSystem::MAX_STEP = 0.1f;
+
+void ParticleSystem::init(VkDevice device, Allocator* allocator, VkQueue queue, uint32_t queueFamily, uint32_t graphicFamily,
+	VkShaderModule shader, VkPipelineCache pipelineCache, uint32_t particleCount, uint32_t slotCount)
+{
+	device_ = device;
+	allocator_ = allocator;
+	queue_ = queue;
+	queueFamily_ = queueFamily;
+	graphicFamily_ = graphicFamily;
+	count_ = particleCount;
+	reset_ = true;
+
+	createPipeline(shader, pipelineCache);
+	createBuffers(slotCount);
+	createDescriptorSets();
+	createCommandBuffers();
+
+	lastStep_ = Clock::now();
+}
+
+void ParticleSystem::destroy()
+{
+	if (!device_)
+		return;
+
+	for (auto& slot : slots_) {
+		allocator_->destroyBuffer(slot.instanceBuffer, slot.instanceAllocation);
+		if (slot.finished)
+			vkDestroySemaphore(device_, slot.finished, nullptr);
+	}
+	slots_.clear();
+
+	allocator_->destroyBuffer(stateBuffer_, stateAllocation_);
+
+	// sets and command buffers go with their pools
+	if (commandPool_) {
+		vkDestroyCommandPool(device_, commandPool_, nullptr);
+		commandPool_ = VK_NULL_HANDLE;
+	}
+
+	if (descriptorPool_) {
+		vkDestroyDescriptorPool(device_, descriptorPool_, nullptr);
+		descriptorPool_ = VK_NULL_HANDLE;
+	}
+
+	if (pipeline_) {
+		vkDestroyPipeline(device_, pipeline_, nullptr);
+		pipeline_ = VK_NULL_HANDLE;
+	}
+
+	if (pipelineLayout_) {
+		vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
+		pipelineLayout_ = VK_NULL_HANDLE;
+	}
+
+	if (descriptorSetLayout_) {
+		vkDestroyDescriptorSetLayout(device_, descriptorSetLayout_, nullptr);
+		descriptorSetLayout_ = VK_NULL_HANDLE;
+	}
+
+	device_ = VK_NULL_HANDLE;
+}
+
+VkSemaphore ParticleSystem::simulate(uint32_t slot)
+{
+	auto now = Clock::now();
+	float deltaTime = std::min(std::chrono::duration<float>(now - lastStep_).count(), MAX_STEP);
+	lastStep_ = now;
+
+	// command buffer of the slot was last used by frame the caller has waited on
+	Slot& current = slots_[slot];
+	vkResetCommandBuffer(current.commandBuffer, 0);
+	recordStep(current, deltaTime);
+
+	VkSubmitInfo submitInfo = { };
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &current.commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &current.finished;
+
+	if (vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		throw std::runtime_error("failed to submit particle simulation");
+
+	reset_ = false;
+	return current.finished;
+}
+
+// private functions
+void ParticleSystem::createPipeline(VkShaderModule shader, VkPipelineCache pipelineCache)
+{
+	VkDescriptorSetLayoutBinding bindings[2] = { };
+	for (uint32_t i = 0; i < 2; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutInfo = { };
+	setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutInfo.bindingCount = 2;
+	setLayoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(device_, &setLayoutInfo, nullptr, &descriptorSetLayout_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create particle descriptor set layout");
+
+	VkPushConstantRange pushConstantRange = { };
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(StepConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = { };
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout_;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create particle pipeline layout");
+
+	VkComputePipelineCreateInfo createInfo = { };
+	createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	createInfo.stage.module = shader;
+	createInfo.stage.pName = "main";
+	createInfo.layout = pipelineLayout_;
+	createInfo.basePipelineIndex = -1;
+
+	if (vkCreateComputePipelines(device_, pipelineCache, 1, &createInfo, nullptr, &pipeline_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create particle pipeline");
+}
+
+void ParticleSystem::createBuffers(uint32_t slotCount)
+{
+	VkBufferCreateInfo stateInfo = { };
+	stateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	stateInfo.size = sizeof(Particle) * count_;
+	stateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	stateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	// contents don't matter, first step seeds them
+	allocator_->createBuffer(stateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, stateBuffer_, stateAllocation_);
+
+	// written on compute queue, read by vertex fetch on graphics queue
+	uint32_t families[] = { queueFamily_, graphicFamily_ };
+
+	VkBufferCreateInfo instanceInfo = { };
+	instanceInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	instanceInfo.size = sizeof(InstanceData) * count_;
+	instanceInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	if (isAsync()) {
+		instanceInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		instanceInfo.queueFamilyIndexCount = 2;
+		instanceInfo.pQueueFamilyIndices = families;
+	}
+	else {
+		instanceInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	}
+
+	slots_.resize(slotCount);
+	for (auto& slot : slots_)
+		allocator_->createBuffer(instanceInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.instanceBuffer, slot.instanceAllocation);
+}
+
+void ParticleSystem::createDescriptorSets()
+{
+	VkDescriptorPoolSize poolSize = { };
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = 2 * (uint32_t)slots_.size();
+
+	VkDescriptorPoolCreateInfo poolInfo = { };
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = (uint32_t)slots_.size();
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (vkCreateDescriptorPool(device_, &poolInfo, nullptr, &descriptorPool_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create particle descriptor pool");
+
+	std::vector<VkDescriptorSetLayout> layouts(slots_.size(), descriptorSetLayout_);
+	std::vector<VkDescriptorSet> sets(slots_.size());
+
+	VkDescriptorSetAllocateInfo allocInfo = { };
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool_;
+	allocInfo.descriptorSetCount = (uint32_t)sets.size();
+	allocInfo.pSetLayouts = layouts.data();
+
+	if (vkAllocateDescriptorSets(device_, &allocInfo, sets.data()) != VK_SUCCESS)
+		throw std::runtime_error("failed to allocate particle descriptor sets");
+
+	// sets never change, buffers live as long as the system
+	for (size_t i = 0; i < slots_.size(); ++i) {
+		slots_[i].descriptorSet = sets[i];
+
+		VkDescriptorBufferInfo bufferInfos[] = {
+			{ stateBuffer_, 0, VK_WHOLE_SIZE },
+			{ slots_[i].instanceBuffer, 0, VK_WHOLE_SIZE }
+		};
+
+		VkWriteDescriptorSet write = { };
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = sets[i];
+		write.dstBinding = 0;
+		write.descriptorCount = 2;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = bufferInfos;
+
+		vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+	}
+}
+
+void ParticleSystem::createCommandBuffers()
+{
+	VkCommandPoolCreateInfo poolInfo = { };
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = queueFamily_;
+
+	if (vkCreateCommandPool(device_, &poolInfo, nullptr, &commandPool_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create particle command pool");
+
+	std::vector<VkCommandBuffer> commandBuffers(slots_.size());
+
+	VkCommandBufferAllocateInfo allocInfo = { };
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = commandPool_;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+
+	if (vkAllocateCommandBuffers(device_, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+		throw std::runtime_error("failed to allocate particle command buffers");
+
+	VkSemaphoreCreateInfo semaphoreInfo = { };
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for (size_t i = 0; i < slots_.size(); ++i) {
+		slots_[i].commandBuffer = commandBuffers[i];
+
+		if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &slots_[i].finished) != VK_SUCCESS)
+			throw std::runtime_error("failed to create semaphore");
+	}
+}
+
+void ParticleSystem::recordStep(Slot& slot, float deltaTime)
+{
+	VkCommandBufferBeginInfo beginInfo = { };
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+
+	// previous step wrote state this one reads, both on this queue
+	VkMemoryBarrier barrier = { };
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(slot.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+	vkCmdBindDescriptorSets(slot.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1,
+		&slot.descriptorSet, 0, nullptr);
+
+	StepConstants constants = { deltaTime, count_, reset_ ? 1u : 0u };
+	vkCmdPushConstants(slot.commandBuffer, pipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+	vkCmdDispatch(slot.commandBuffer, (count_ + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+	// instance writes become visible to vertex fetch through semaphore graphics submit waits on
+	if (vkEndCommandBuffer(slot.commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("failed to record particle simulation");
+}
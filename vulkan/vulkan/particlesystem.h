@@ -0,0 +1,90 @@
+#ifndef PARTICLESYSTEM_H_
+#define PARTICLESYSTEM_H_
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <chrono>
+#include "allocator.h"
+
+// Particle simulation run by compute shader, cpu never touches particle data.
+// Shader advances particle state and writes per instance attributes straight into a vertex
+// buffer, graphics draws it as instance stream. Dispatches go to dedicated compute queue when
+// device has one, so simulation of a frame overlaps rasterization of the previous one.
+// Every frame slot has own instance buffer, command buffer and semaphore; graphics submit
+// of the slot waits on the semaphore at vertex input, so only vertex fetch waits for compute.
+// Instance buffers are shared concurrently by both families, no ownership transfers needed.
+class ParticleSystem {
+	struct Slot {
+		VkBuffer instanceBuffer = VK_NULL_HANDLE;
+		Allocation instanceAllocation;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkSemaphore finished = VK_NULL_HANDLE;
+	};
+
+	// same layout as particles.comp
+	struct Particle {
+		float positionVelocity[4];
+		float spin[4];
+	};
+
+	struct StepConstants {
+		float deltaTime;
+		uint32_t count;
+		uint32_t reset;
+	};
+
+	typedef std::chrono::steady_clock Clock;
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	Allocator* allocator_ = nullptr;
+	VkQueue queue_ = VK_NULL_HANDLE;
+	uint32_t queueFamily_ = 0;
+	uint32_t graphicFamily_ = 0;
+
+	VkDescriptorSetLayout descriptorSetLayout_ = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+	VkPipeline pipeline_ = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+	VkCommandPool commandPool_ = VK_NULL_HANDLE;
+
+	// read and written only by compute queue, dispatches are ordered by barrier
+	VkBuffer stateBuffer_ = VK_NULL_HANDLE;
+	Allocation stateAllocation_;
+
+	std::vector<Slot> slots_;
+	uint32_t count_ = 0;
+	bool reset_ = true;
+	Clock::time_point lastStep_;
+
+	static const uint32_t GROUP_SIZE = 64;			// local_size_x of particles.comp
+	static const float MAX_STEP;					// seconds, long stalls don't throw particles away
+
+private:
+	void createPipeline(VkShaderModule, VkPipelineCache);
+	void createBuffers(uint32_t slotCount);
+	void createDescriptorSets();
+	void createCommandBuffers();
+	void recordStep(Slot&, float deltaTime);
+
+public:
+	ParticleSystem() = default;
+	ParticleSystem(const ParticleSystem&) = delete;
+	ParticleSystem& operator=(const ParticleSystem&) = delete;
+	~ParticleSystem() { destroy(); }
+
+	// queue is dedicated compute queue or graphics queue, then queueFamily equals graphicFamily
+	void init(VkDevice, Allocator*, VkQueue, uint32_t queueFamily, uint32_t graphicFamily,
+		VkShaderModule, VkPipelineCache, uint32_t particleCount, uint32_t slotCount);
+	void destroy();		// device must be idle
+
+	// submit simulation step writing instance buffer of the slot, graphics submit of the slot
+	// must wait on returned semaphore; called after slot's previous frame was waited on
+	VkSemaphore simulate(uint32_t slot);
+
+	VkBuffer instanceBuffer(uint32_t slot) const { return slots_[slot].instanceBuffer; }
+	uint32_t count() const { return count_; }
+	bool isAsync() const { return queueFamily_ != graphicFamily_; }
+};
+
+#endif // PARTICLESYSTEM_H_
@@ -0,0 +1,148 @@
+#include "pipelinecache.h"
+#include <stdexcept>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+void PipelineCache::create(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path)
+{
+	device_ = device;
+	path_ = path;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties_);
+
+	auto data = loadData();
+	warm_ = !data.empty();
+
+	VkPipelineCacheCreateInfo createInfo = { };
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = data.size();
+	createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(device_, &createInfo, nullptr, &cache_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create pipeline cache");
+}
+
+void PipelineCache::save()
+{
+	if (!cache_ || path_.empty())
+		return;
+
+	size_t size = 0;
+	if (vkGetPipelineCacheData(device_, cache_, &size, nullptr) != VK_SUCCESS || size == 0)
+		return;
+
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(device_, cache_, &size, data.data()) != VK_SUCCESS)
+		return;
+	data.resize(size);
+
+	FileHeader header = { };
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.vendorID = properties_.vendorID;
+	header.deviceID = properties_.deviceID;
+	header.driverVersion = properties_.driverVersion;
+	memcpy(header.pipelineCacheUUID, properties_.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = data.size();
+	header.checksum = checksum(data.data(), data.size());
+
+	// write next to old file and swap it in, so crash while writing never leaves broken cache
+	std::string tmpPath = path_ + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), data.size());
+		file.flush();
+
+		if (!file.good()) {
+			file.close();
+			std::remove(tmpPath.c_str());
+			return;
+		}
+	}
+
+#ifdef _WIN32
+	MoveFileExA(tmpPath.c_str(), path_.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	std::rename(tmpPath.c_str(), path_.c_str());
+#endif
+}
+
+void PipelineCache::destroy()
+{
+	if (cache_) {
+		vkDestroyPipelineCache(device_, cache_, nullptr);
+		cache_ = VK_NULL_HANDLE;
+	}
+}
+
+std::vector<char> PipelineCache::loadData()
+{
+	std::ifstream file(path_, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return { };
+
+	auto fileSize = (uint64_t)file.tellg();
+	file.seekg(0);
+
+	FileHeader header = { };
+	if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return { };
+
+	// size is read from the file, so a truncated or corrupt file must not decide what gets allocated
+	if (header.magic != MAGIC || header.version != VERSION || header.dataSize == 0 ||
+		header.dataSize != fileSize - sizeof(header))
+		return { };
+
+	std::vector<char> data((size_t)header.dataSize);
+	if (!file.read(data.data(), data.size()))
+		return { };
+
+	if (!isValid(header, data))
+		return { };
+
+	return data;
+}
+
+bool PipelineCache::isValid(const FileHeader& header, const std::vector<char>& data)
+{
+	if (header.vendorID != properties_.vendorID || header.deviceID != properties_.deviceID ||
+		header.driverVersion != properties_.driverVersion ||
+		memcmp(header.pipelineCacheUUID, properties_.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		return false;
+
+	if (header.checksum != checksum(data.data(), data.size()))
+		return false;
+
+	// vulkan own header in front of blob: length, version, vendor, device, uuid
+	const size_t vkHeaderSize = 16 + VK_UUID_SIZE;
+	if (data.size() < vkHeaderSize)
+		return false;
+
+	uint32_t vkHeader[4];
+	memcpy(vkHeader, data.data(), sizeof(vkHeader));
+
+	return vkHeader[0] >= vkHeaderSize && vkHeader[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		vkHeader[2] == properties_.vendorID && vkHeader[3] == properties_.deviceID &&
+		memcmp(data.data() + 16, properties_.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+uint64_t PipelineCache::checksum(const char* data, size_t size)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= (uint8_t)data[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
@@ -0,0 +1,47 @@
+#ifndef PIPELINECACHE_H_
+#define PIPELINECACHE_H_
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+// VkPipelineCache that lives on disk between runs.
+// File is our header (device identity + checksum) followed by vkGetPipelineCacheData blob,
+// data from another device, driver or a damaged file is dropped and cache starts cold.
+class PipelineCache {
+	VkDevice device_ = VK_NULL_HANDLE;
+	VkPipelineCache cache_ = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties properties_ = { };
+	std::string path_;
+	bool warm_ = false;
+
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+		uint64_t checksum;
+	};
+
+	static const uint32_t MAGIC = 0x43504b56;	// "VKPC"
+	static const uint32_t VERSION = 1;
+
+private:
+	std::vector<char> loadData();
+	bool isValid(const FileHeader&, const std::vector<char>& data);
+
+	static uint64_t checksum(const char* data, size_t size);
+
+public:
+	void create(VkPhysicalDevice, VkDevice, const std::string& path);
+	void save();
+	void destroy();
+
+	VkPipelineCache handle() const { return cache_; }
+	bool isWarm() const { return warm_; }		// true if data was loaded from disk
+};
+
+#endif // PIPELINECACHE_H_
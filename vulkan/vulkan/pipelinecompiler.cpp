@@ -0,0 +1,98 @@
+#include "pipelinecompiler.h"
+#include <chrono>
+#include <exception>
+
+void PipelineCompiler::init(VkDevice device)
+{
+	destroy();
+
+	device_ = device;
+	stop_ = false;
+	thread_ = std::thread(&PipelineCompiler::worker, this);
+}
+
+void PipelineCompiler::destroy()
+{
+	if (!thread_.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+		pending_ = nullptr;
+	}
+	wake_.notify_all();
+	thread_.join();
+
+	for (auto& result : results_) {
+		for (auto pipeline : result.pipelines)
+			vkDestroyPipeline(device_, pipeline, nullptr);
+	}
+	results_.clear();
+}
+
+uint64_t PipelineCompiler::submit(BuildFunction build)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	pending_ = std::move(build);
+	pendingId_ = nextId_++;
+	wake_.notify_all();
+
+	return pendingId_;
+}
+
+bool PipelineCompiler::poll(Result& result)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (results_.empty())
+		return false;
+
+	result = results_.front();
+	results_.erase(results_.begin());
+	return true;
+}
+
+void PipelineCompiler::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	idle_.wait(lock, [this] { return !pending_ && !building_; });
+}
+
+// private functions
+void PipelineCompiler::worker()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	for (;;) {
+		wake_.wait(lock, [this] { return stop_ || pending_; });
+		if (stop_)
+			break;
+
+		BuildFunction build = std::move(pending_);
+		pending_ = nullptr;
+		building_ = true;
+
+		Result result;
+		result.id = pendingId_;
+		lock.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+		try {
+			result.pipelines = build();
+		}
+		catch (const std::exception& e) {
+			result.error = e.what();
+		}
+		result.time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		lock.lock();
+		if (!result.pipelines.empty() || !result.error.empty())
+			results_.push_back(result);
+
+		building_ = false;
+		idle_.notify_all();
+	}
+
+	building_ = false;
+	idle_.notify_all();
+}
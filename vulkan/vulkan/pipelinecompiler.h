@@ -0,0 +1,62 @@
+#ifndef PIPELINECOMPILER_H_
+#define PIPELINECOMPILER_H_
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Builds pipeline sets on its own worker thread, so render thread never waits for a compile.
+// Only the newest request matters: request submitted while another one still waits
+// replaces it. Finished pipelines are taken with poll() at frame boundary, until then
+// the caller keeps rendering with the pipeline it has.
+class PipelineCompiler {
+public:
+	// returns new pipelines, or nothing if there is nothing to rebuild; throws on failure
+	typedef std::function<std::vector<VkPipeline>()> BuildFunction;
+
+	struct Result {
+		uint64_t id = 0;
+		std::vector<VkPipeline> pipelines;
+		std::string error;				// set if build threw
+		double time = 0.0;				// ms spent building
+	};
+
+private:
+	VkDevice device_ = VK_NULL_HANDLE;
+	std::thread thread_;
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable idle_;
+
+	BuildFunction pending_;
+	uint64_t pendingId_ = 0;
+	uint64_t nextId_ = 1;
+	bool building_ = false;
+	bool stop_ = false;
+	std::vector<Result> results_;
+
+private:
+	void worker();
+
+public:
+	PipelineCompiler() = default;
+	PipelineCompiler(const PipelineCompiler&) = delete;
+	PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+	~PipelineCompiler() { destroy(); }
+
+	void init(VkDevice);
+	void destroy();		// waits for running build, destroys pipelines nobody took
+
+	uint64_t submit(BuildFunction);
+	bool poll(Result&);
+
+	// block until nothing waits or builds, e.g. before destroying objects builds use
+	void wait();
+};
+
+#endif // PIPELINECOMPILER_H_
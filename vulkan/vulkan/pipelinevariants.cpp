@@ -0,0 +1,102 @@
+#include "pipelinevariants.h"
+#include <stdexcept>
+
+uint64_t PipelineKey::hash() const
+{
+	// FNV-1a over fields, not bytes, so padding never takes part
+	uint32_t fields[] = { (uint32_t)topology, (uint32_t)polygonMode, (uint32_t)cullMode, blend, colorMode };
+
+	uint64_t hash = 14695981039346656037ull;
+	for (uint32_t field : fields) {
+		hash ^= field;
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+bool PipelineKey::operator==(const PipelineKey& other) const
+{
+	return topology == other.topology && polygonMode == other.polygonMode && cullMode == other.cullMode &&
+		blend == other.blend && colorMode == other.colorMode;
+}
+
+void PipelineVariants::declare(const std::vector<PipelineKey>& keys)
+{
+	if (keys.empty())
+		throw std::runtime_error("pipeline variant set is empty");
+
+	keys_.clear();
+	indices_.clear();
+
+	for (const auto& key : keys) {
+		auto it = indices_.find(key.hash());
+		if (it != indices_.end()) {
+			if (keys_[it->second] == key)
+				continue;		// declared twice
+			throw std::runtime_error("pipeline key hash collision");
+		}
+
+		indices_[key.hash()] = keys_.size();
+		keys_.push_back(key);
+	}
+}
+
+std::vector<VkPipeline> PipelineVariants::build(VkDevice device, ThreadPool* pool, const BuildFunction& buildVariant) const
+{
+	std::vector<VkPipeline> pipelines(keys_.size(), VK_NULL_HANDLE);
+
+	try {
+		pipelines[0] = buildVariant(keys_[0], VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT, VK_NULL_HANDLE);
+
+		auto buildDerivative = [&](uint32_t task, uint32_t) {
+			pipelines[task + 1] = buildVariant(keys_[task + 1], VK_PIPELINE_CREATE_DERIVATIVE_BIT, pipelines[0]);
+		};
+
+		uint32_t derivativeCount = (uint32_t)keys_.size() - 1;
+		if (pool)
+			pool->parallelFor(derivativeCount, buildDerivative);
+		else {
+			for (uint32_t i = 0; i < derivativeCount; ++i)
+				buildDerivative(i, 0);
+		}
+	}
+	catch (...) {
+		// caller gets all variants or none, half built set is never swapped in
+		for (auto pipeline : pipelines) {
+			if (pipeline)
+				vkDestroyPipeline(device, pipeline, nullptr);
+		}
+		throw;
+	}
+
+	return pipelines;
+}
+
+std::vector<VkPipeline> PipelineVariants::replace(std::vector<VkPipeline> pipelines)
+{
+	if (pipelines.size() != keys_.size())
+		throw std::runtime_error("pipeline count doesn't match declared variants");
+
+	pipelines_.swap(pipelines);
+	return pipelines;
+}
+
+void PipelineVariants::destroy(VkDevice device)
+{
+	for (auto pipeline : pipelines_) {
+		if (pipeline)
+			vkDestroyPipeline(device, pipeline, nullptr);
+	}
+
+	pipelines_.clear();
+}
+
+VkPipeline PipelineVariants::get(const PipelineKey& key) const
+{
+	auto it = indices_.find(key.hash());
+	if (it == indices_.end() || !(keys_[it->second] == key))
+		return VK_NULL_HANDLE;
+
+	return get(it->second);
+}
@@ -0,0 +1,68 @@
+#ifndef PIPELINEVARIANTS_H_
+#define PIPELINEVARIANTS_H_
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include "threadpool.h"
+
+// fixed function state and shader permutation of one pipeline variant
+struct PipelineKey {
+	enum Blend : uint32_t {
+		BLEND_OPAQUE,
+		BLEND_ALPHA,
+		BLEND_ADDITIVE,
+	};
+
+	// fragment shader specialization constant 0
+	enum ColorMode : uint32_t {
+		COLOR_VERTEX,
+		COLOR_LUMINANCE,
+		COLOR_INVERTED,
+	};
+
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	uint32_t blend = BLEND_OPAQUE;
+	uint32_t colorMode = COLOR_VERTEX;
+
+	uint64_t hash() const;
+	bool operator==(const PipelineKey& other) const;
+};
+
+// Set of pipelines declared up front and looked up by key while recording.
+// First declared key is the base pipeline, the rest are created as its derivatives,
+// so driver can reuse work done for base. Base is built first, then derivatives
+// in parallel on thread pool, all through one shared pipeline cache.
+class PipelineVariants {
+public:
+	// builds one variant, called from pool threads
+	typedef std::function<VkPipeline(const PipelineKey&, VkPipelineCreateFlags, VkPipeline basePipeline)> BuildFunction;
+
+private:
+	std::vector<PipelineKey> keys_;
+	std::vector<VkPipeline> pipelines_;
+	std::unordered_map<uint64_t, size_t> indices_;		// key hash -> index
+
+public:
+	void declare(const std::vector<PipelineKey>&);
+
+	// pool may be null, then variants are built one by one on calling thread;
+	// on failure pipelines built so far are destroyed and exception is rethrown
+	std::vector<VkPipeline> build(VkDevice, ThreadPool*, const BuildFunction&) const;
+
+	// take pipelines built for declared keys, returns previous ones
+	std::vector<VkPipeline> replace(std::vector<VkPipeline> pipelines);
+	void destroy(VkDevice);
+
+	// null if key wasn't declared
+	VkPipeline get(const PipelineKey&) const;
+	VkPipeline get(size_t index) const { return index < pipelines_.size() ? pipelines_[index] : VK_NULL_HANDLE; }
+
+	const std::vector<PipelineKey>& keys() const { return keys_; }
+	size_t size() const { return keys_.size(); }
+};
+
+#endif // PIPELINEVARIANTS_H_
@@ -0,0 +1,800 @@
+#include "rendergraph.h"
+#include <stdexcept>
+#include <algorithm>
+
+// everything earlier frames, render passes and aliased images may still be doing to an attachment
+static const VkPipelineStageFlags EXTERNAL_STAGES = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+	VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+static const VkAccessFlags EXTERNAL_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+static const VkAccessFlags WRITE_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+RenderGraph::Resource RenderGraph::importImage(const std::string& name, VkFormat format, VkImageLayout finalLayout)
+{
+	Image image;
+	image.name = name;
+	image.format = format;
+	image.imported = true;
+	image.output = true;
+	image.finalLayout = finalLayout;
+	images_.push_back(image);
+
+	return (Resource)images_.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::createImage(const std::string& name, VkFormat format)
+{
+	Image image;
+	image.name = name;
+	image.format = format;
+	images_.push_back(image);
+
+	return (Resource)images_.size() - 1;
+}
+
+void RenderGraph::markOutput(Resource resource)
+{
+	images_.at(resource).output = true;
+}
+
+uint32_t RenderGraph::addPass(const std::string& name, RecordFunction record)
+{
+	if (isCompiled())
+		throw std::runtime_error("render graph is compiled, pass " + name + " can't be added");
+
+	Pass pass;
+	pass.name = name;
+	pass.record = std::move(record);
+	passes_.push_back(pass);
+
+	return (uint32_t)passes_.size() - 1;
+}
+
+void RenderGraph::addColorOutput(uint32_t pass, Resource resource, VkAttachmentLoadOp loadOp, VkClearColorValue clear)
+{
+	VkClearValue clearValue = { };
+	clearValue.color = clear;
+	use(pass, resource, USAGE_COLOR, loadOp, clearValue);
+}
+
+void RenderGraph::setDepthOutput(uint32_t pass, Resource resource, VkAttachmentLoadOp loadOp, float clearDepth)
+{
+	for (const auto& use : passes_.at(pass).uses) {
+		if (use.usage == USAGE_DEPTH)
+			throw std::runtime_error("pass " + passes_[pass].name + " already has depth output");
+	}
+
+	VkClearValue clearValue = { };
+	clearValue.depthStencil = { clearDepth, 0 };
+	use(pass, resource, USAGE_DEPTH, loadOp, clearValue);
+}
+
+void RenderGraph::addInput(uint32_t pass, Resource resource)
+{
+	use(pass, resource, USAGE_INPUT, VK_ATTACHMENT_LOAD_OP_LOAD, { });
+}
+
+void RenderGraph::addTexture(uint32_t pass, Resource resource)
+{
+	if (images_.at(resource).imported)
+		throw std::runtime_error("imported image " + images_[resource].name + " can't be sampled");
+
+	use(pass, resource, USAGE_SAMPLED, VK_ATTACHMENT_LOAD_OP_LOAD, { });
+}
+
+void RenderGraph::compile(VkDevice device)
+{
+	if (passes_.empty())
+		throw std::runtime_error("render graph has no passes");
+
+	device_ = device;
+	stats_ = { };
+	stats_.passCount = (uint32_t)passes_.size();
+
+	cullPasses();
+	groupPasses();
+
+	// lifetimes in render passes decide what is loaded, stored and which transients may alias
+	for (uint32_t i = 0; i < renderPasses_.size(); ++i) {
+		for (uint32_t passIndex : renderPasses_[i].passes) {
+			for (const auto& use : passes_[passIndex].uses) {
+				Image& image = images_[use.resource];
+				if (image.firstRenderPass < 0)
+					image.firstRenderPass = (int32_t)i;
+				image.lastRenderPass = (int32_t)i;
+
+				switch (use.usage) {
+				case USAGE_COLOR: image.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; break;
+				case USAGE_DEPTH: image.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT; break;
+				case USAGE_INPUT: image.usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT; break;
+				case USAGE_SAMPLED: image.usage |= VK_IMAGE_USAGE_SAMPLED_BIT; break;
+				}
+			}
+		}
+	}
+
+	// content that never leaves one render pass needn't be backed by memory on tilers
+	for (auto& image : images_) {
+		if (!image.imported && !image.output && image.firstRenderPass >= 0 &&
+			image.firstRenderPass == image.lastRenderPass && !(image.usage & VK_IMAGE_USAGE_SAMPLED_BIT))
+			image.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	}
+
+	// state every image is left in by render passes so far
+	std::vector<VkImageLayout> layouts(images_.size(), VK_IMAGE_LAYOUT_UNDEFINED);
+	std::vector<VkPipelineStageFlags> stages(images_.size(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	std::vector<VkAccessFlags> accesses(images_.size(), 0);
+
+	try {
+		for (auto& renderPass : renderPasses_)
+			createRenderPass(renderPass, layouts, stages, accesses);
+	}
+	catch (...) {
+		for (auto& renderPass : renderPasses_) {
+			if (renderPass.handle)
+				vkDestroyRenderPass(device_, renderPass.handle, nullptr);
+		}
+		renderPasses_.clear();
+		throw;
+	}
+
+	stats_.renderPassCount = (uint32_t)renderPasses_.size();
+}
+
+void RenderGraph::createTargets(Allocator* allocator, VkExtent2D extent,
+	const std::vector<std::vector<VkImageView>>& importedViews)
+{
+	allocator_ = allocator;
+	extent_ = extent;
+
+	size_t framebufferCount = 1;
+	size_t importIndex = 0;
+	for (auto& image : images_) {
+		if (!image.imported)
+			continue;
+
+		if (importIndex >= importedViews.size() || importedViews[importIndex].empty())
+			throw std::runtime_error("no views for imported image " + image.name);
+
+		image.views = importedViews[importIndex++];
+		framebufferCount = std::max(framebufferCount, image.views.size());
+	}
+
+	createImages();
+
+	for (auto& renderPass : renderPasses_) {
+		renderPass.framebuffers.resize(framebufferCount, VK_NULL_HANDLE);
+
+		for (size_t i = 0; i < framebufferCount; ++i) {
+			std::vector<VkImageView> attachments;
+			for (Resource resource : renderPass.attachments) {
+				const Image& image = images_[resource];
+				attachments.push_back(image.imported ? image.views[std::min(i, image.views.size() - 1)] : image.view);
+			}
+
+			VkFramebufferCreateInfo createInfo = { };
+			createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			createInfo.renderPass = renderPass.handle;
+			createInfo.attachmentCount = (uint32_t)attachments.size();
+			createInfo.pAttachments = attachments.data();
+			createInfo.width = extent_.width;
+			createInfo.height = extent_.height;
+			createInfo.layers = 1;
+
+			if (vkCreateFramebuffer(device_, &createInfo, nullptr, &renderPass.framebuffers[i]) != VK_SUCCESS)
+				throw std::runtime_error("failed to create framebuffer!");
+		}
+	}
+}
+
+std::function<void()> RenderGraph::releaseTargets()
+{
+	std::vector<VkFramebuffer> framebuffers;
+	for (auto& renderPass : renderPasses_) {
+		framebuffers.insert(framebuffers.end(), renderPass.framebuffers.begin(), renderPass.framebuffers.end());
+		renderPass.framebuffers.clear();
+	}
+
+	std::vector<VkImageView> views;
+	std::vector<VkImage> images;
+	for (auto& image : images_) {
+		if (image.view)
+			views.push_back(image.view);
+		if (image.image)
+			images.push_back(image.image);
+
+		image.view = VK_NULL_HANDLE;
+		image.image = VK_NULL_HANDLE;
+		image.heap = -1;
+		image.views.clear();
+	}
+
+	std::vector<Allocation> allocations;
+	for (auto& heap : heaps_)
+		allocations.push_back(heap.allocation);
+	heaps_.clear();
+
+	stats_.transientCount = 0;
+	stats_.lazyCount = 0;
+	stats_.heapCount = 0;
+	stats_.transientBytes = 0;
+	stats_.heapBytes = 0;
+
+	VkDevice device = device_;
+	Allocator* allocator = allocator_;
+
+	return [device, allocator, framebuffers, views, images, allocations]() mutable {
+		for (auto framebuffer : framebuffers) {
+			if (framebuffer)
+				vkDestroyFramebuffer(device, framebuffer, nullptr);
+		}
+
+		for (auto view : views)
+			vkDestroyImageView(device, view, nullptr);
+
+		for (auto image : images)
+			vkDestroyImage(device, image, nullptr);
+
+		for (auto& allocation : allocations)
+			allocator->free(allocation);
+	};
+}
+
+std::function<void()> RenderGraph::release()
+{
+	auto destroyTargets = releaseTargets();
+
+	std::vector<VkRenderPass> handles;
+	for (const auto& renderPass : renderPasses_)
+		handles.push_back(renderPass.handle);
+
+	renderPasses_.clear();
+	passes_.clear();
+	images_.clear();
+	stats_ = { };
+
+	VkDevice device = device_;
+	return [device, handles, destroyTargets] {
+		destroyTargets();
+
+		for (auto handle : handles)
+			vkDestroyRenderPass(device, handle, nullptr);
+	};
+}
+
+void RenderGraph::destroy()
+{
+	if (!device_)
+		return;
+
+	release()();
+	device_ = VK_NULL_HANDLE;
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t framebufferIndex)
+{
+	for (const auto& renderPass : renderPasses_) {
+		// images sampled in this render pass were written by earlier ones
+		if (!renderPass.transitions.empty()) {
+			std::vector<VkImageMemoryBarrier> barriers;
+			VkPipelineStageFlags srcStage = 0;
+			VkPipelineStageFlags dstStage = 0;
+
+			for (const auto& transition : renderPass.transitions) {
+				VkImageMemoryBarrier barrier = { };
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.srcAccessMask = transition.srcAccess;
+				barrier.dstAccessMask = transition.dstAccess;
+				barrier.oldLayout = transition.oldLayout;
+				barrier.newLayout = transition.newLayout;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.image = images_[transition.resource].image;
+				barrier.subresourceRange.aspectMask = isDepthFormat(images_[transition.resource].format) ?
+					VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+				barrier.subresourceRange.levelCount = 1;
+				barrier.subresourceRange.layerCount = 1;
+				barriers.push_back(barrier);
+
+				srcStage |= transition.srcStage;
+				dstStage |= transition.dstStage;
+			}
+
+			vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr,
+				(uint32_t)barriers.size(), barriers.data());
+		}
+
+		VkFramebuffer framebuffer = renderPass.framebuffers[std::min<size_t>(framebufferIndex, renderPass.framebuffers.size() - 1)];
+
+		VkRenderPassBeginInfo beginInfo = { };
+		beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		beginInfo.renderPass = renderPass.handle;
+		beginInfo.framebuffer = framebuffer;
+		beginInfo.renderArea.offset = { 0, 0 };
+		beginInfo.renderArea.extent = extent_;
+		beginInfo.clearValueCount = (uint32_t)renderPass.clearValues.size();
+		beginInfo.pClearValues = renderPass.clearValues.data();
+
+		for (uint32_t subpass = 0; subpass < renderPass.passes.size(); ++subpass) {
+			const Pass& pass = passes_[renderPass.passes[subpass]];
+
+			if (subpass == 0)
+				vkCmdBeginRenderPass(commandBuffer, &beginInfo, pass.contents);
+			else
+				vkCmdNextSubpass(commandBuffer, pass.contents);
+
+			PassContext context = { commandBuffer, renderPass.handle, subpass, framebuffer };
+			if (pass.record)
+				pass.record(context);
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+}
+
+void RenderGraph::print(std::ostream& out) const
+{
+	out << "Render graph: " << stats_.passCount << " passes, " << stats_.culledCount << " culled, "
+		<< stats_.renderPassCount << " render passes\n";
+
+	for (size_t i = 0; i < renderPasses_.size(); ++i) {
+		out << "  render pass " << i << ":";
+		for (uint32_t pass : renderPasses_[i].passes)
+			out << ' ' << passes_[pass].name;
+		out << '\n';
+	}
+
+	for (const auto& pass : passes_) {
+		if (pass.culled)
+			out << "  culled: " << pass.name << '\n';
+	}
+
+	out << "  transients: " << stats_.transientCount << " images, " << stats_.transientBytes / 1024 << " KB in "
+		<< stats_.heapCount << " heaps, " << stats_.heapBytes / 1024 << " KB, " << stats_.lazyCount << " lazily allocated" << std::endl;
+}
+
+// private functions
+bool RenderGraph::isDepthFormat(VkFormat format)
+{
+	switch (format) {
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+VkImageLayout RenderGraph::usageLayout(Usage usage, VkFormat format)
+{
+	switch (usage) {
+	case USAGE_COLOR:
+		return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	case USAGE_DEPTH:
+		return VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	default:
+		return isDepthFormat(format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+}
+
+VkPipelineStageFlags RenderGraph::usageStage(Usage usage)
+{
+	switch (usage) {
+	case USAGE_COLOR:
+		return VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	case USAGE_DEPTH:
+		return VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	default:
+		return VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+}
+
+VkAccessFlags RenderGraph::usageAccess(Usage usage)
+{
+	switch (usage) {
+	case USAGE_COLOR:
+		return VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	case USAGE_DEPTH:
+		return VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	case USAGE_INPUT:
+		return VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+	default:
+		return VK_ACCESS_SHADER_READ_BIT;
+	}
+}
+
+bool RenderGraph::hasLazyMemory(uint32_t memoryTypeBits) const
+{
+	const auto& properties = allocator_->memoryProperties();
+	for (uint32_t i = 0; i < properties.memoryTypeCount; ++i) {
+		if ((memoryTypeBits & (1 << i)) && (properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT))
+			return true;
+	}
+
+	return false;
+}
+
+void RenderGraph::use(uint32_t pass, Resource resource, Usage usage, VkAttachmentLoadOp loadOp, VkClearValue clearValue)
+{
+	if (isCompiled())
+		throw std::runtime_error("render graph is compiled, declarations can't change");
+	if (pass >= passes_.size() || resource >= images_.size())
+		throw std::runtime_error("unknown render graph pass or image");
+
+	// reading and writing same image in one pass would be a feedback loop
+	for (const auto& use : passes_[pass].uses) {
+		if (use.resource == resource)
+			throw std::runtime_error("pass " + passes_[pass].name + " uses " + images_[resource].name + " twice");
+	}
+
+	Use use = { resource, usage, loadOp, clearValue };
+	passes_[pass].uses.push_back(use);
+}
+
+void RenderGraph::cullPasses()
+{
+	// walking back from outputs: image content is needed if a later live pass reads or loads it
+	std::vector<bool> needed(images_.size(), false);
+	for (size_t i = 0; i < images_.size(); ++i)
+		needed[i] = images_[i].output;
+
+	for (size_t i = passes_.size(); i-- > 0;) {
+		Pass& pass = passes_[i];
+
+		pass.culled = true;
+		for (const auto& use : pass.uses) {
+			if (isWrite(use.usage) && needed[use.resource])
+				pass.culled = false;
+		}
+
+		if (pass.culled) {
+			++stats_.culledCount;
+			continue;
+		}
+
+		// content before a clearing pass is never seen
+		for (const auto& use : pass.uses) {
+			if (isWrite(use.usage) && use.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD)
+				needed[use.resource] = false;
+		}
+		for (const auto& use : pass.uses) {
+			if (!isWrite(use.usage) || use.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD)
+				needed[use.resource] = true;
+		}
+	}
+
+	if (stats_.culledCount == passes_.size())
+		throw std::runtime_error("render graph writes none of its outputs");
+}
+
+void RenderGraph::groupPasses()
+{
+	renderPasses_.clear();
+
+	// render pass that last used image as attachment or sampled it, -1 - none
+	std::vector<int32_t> attachedIn(images_.size(), -1);
+	std::vector<int32_t> sampledIn(images_.size(), -1);
+
+	for (uint32_t i = 0; i < passes_.size(); ++i) {
+		Pass& pass = passes_[i];
+		if (pass.culled)
+			continue;
+
+		// layout can only change for sampling between render passes
+		int32_t current = (int32_t)renderPasses_.size() - 1;
+		bool split = renderPasses_.empty();
+		for (const auto& use : pass.uses) {
+			if (use.usage == USAGE_SAMPLED && attachedIn[use.resource] == current)
+				split = true;
+			if (use.usage != USAGE_SAMPLED && sampledIn[use.resource] == current)
+				split = true;
+		}
+
+		if (split) {
+			renderPasses_.emplace_back();
+			++current;
+		}
+
+		pass.renderPass = (uint32_t)current;
+		pass.subpass = (uint32_t)renderPasses_.back().passes.size();
+		renderPasses_.back().passes.push_back(i);
+
+		for (const auto& use : pass.uses) {
+			if (use.usage == USAGE_SAMPLED)
+				sampledIn[use.resource] = current;
+			else
+				attachedIn[use.resource] = current;
+		}
+	}
+}
+
+void RenderGraph::createRenderPass(RenderPass& renderPass, std::vector<VkImageLayout>& layouts,
+	std::vector<VkPipelineStageFlags>& stages, std::vector<VkAccessFlags>& accesses)
+{
+	int32_t index = (int32_t)(&renderPass - renderPasses_.data());
+
+	// attachments in order of first use, with every use in subpass order
+	struct AttachmentUse {
+		uint32_t subpass;
+		const Use* use;
+	};
+
+	std::vector<int32_t> attachmentIndex(images_.size(), -1);
+	std::vector<std::vector<AttachmentUse>> attachmentUses;
+
+	for (uint32_t subpass = 0; subpass < renderPass.passes.size(); ++subpass) {
+		for (const auto& use : passes_[renderPass.passes[subpass]].uses) {
+			if (use.usage == USAGE_SAMPLED) {
+				const Image& image = images_[use.resource];
+				if (layouts[use.resource] == VK_IMAGE_LAYOUT_UNDEFINED)
+					throw std::runtime_error("image " + image.name + " is sampled before anything writes it");
+
+				VkImageLayout layout = usageLayout(USAGE_SAMPLED, image.format);
+				if (layouts[use.resource] != layout || (accesses[use.resource] & WRITE_ACCESS)) {
+					Transition transition = { use.resource, layouts[use.resource], layout,
+						stages[use.resource], accesses[use.resource] & WRITE_ACCESS,
+						usageStage(USAGE_SAMPLED), usageAccess(USAGE_SAMPLED) };
+					renderPass.transitions.push_back(transition);
+
+					layouts[use.resource] = layout;
+					stages[use.resource] = usageStage(USAGE_SAMPLED);
+					accesses[use.resource] = usageAccess(USAGE_SAMPLED);
+				}
+				continue;
+			}
+
+			if (attachmentIndex[use.resource] < 0) {
+				attachmentIndex[use.resource] = (int32_t)renderPass.attachments.size();
+				renderPass.attachments.push_back(use.resource);
+				attachmentUses.emplace_back();
+			}
+			attachmentUses[attachmentIndex[use.resource]].push_back({ subpass, &use });
+		}
+	}
+
+	std::vector<VkAttachmentDescription> descriptions;
+	std::vector<VkSubpassDependency> dependencies;
+
+	auto addDependency = [&](uint32_t src, uint32_t dst, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage,
+		VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkDependencyFlags flags) {
+		for (auto& dependency : dependencies) {
+			if (dependency.srcSubpass == src && dependency.dstSubpass == dst) {
+				dependency.srcStageMask |= srcStage;
+				dependency.dstStageMask |= dstStage;
+				dependency.srcAccessMask |= srcAccess;
+				dependency.dstAccessMask |= dstAccess;
+				dependency.dependencyFlags &= flags;
+				return;
+			}
+		}
+
+		VkSubpassDependency dependency = { src, dst, srcStage, dstStage, srcAccess, dstAccess, flags };
+		dependencies.push_back(dependency);
+	};
+
+	renderPass.clearValues.assign(renderPass.attachments.size(), VkClearValue());
+
+	for (size_t a = 0; a < renderPass.attachments.size(); ++a) {
+		Resource resource = renderPass.attachments[a];
+		const Image& image = images_[resource];
+		const auto& uses = attachmentUses[a];
+		const Use& first = *uses.front().use;
+		const Use& last = *uses.back().use;
+
+		bool definedBefore = layouts[resource] != VK_IMAGE_LAYOUT_UNDEFINED;
+		bool usedLater = image.lastRenderPass > index;
+
+		// writes say how they start, reads need what is there; nothing to load in first render pass
+		VkAttachmentLoadOp loadOp = isWrite(first.usage) ? first.loadOp : VK_ATTACHMENT_LOAD_OP_LOAD;
+		if (loadOp == VK_ATTACHMENT_LOAD_OP_LOAD && !definedBefore)
+			loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+		VkAttachmentDescription description = { };
+		description.format = image.format;
+		description.samples = VK_SAMPLE_COUNT_1_BIT;
+		description.loadOp = loadOp;
+		description.storeOp = usedLater || image.output ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		description.initialLayout = loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? layouts[resource] : VK_IMAGE_LAYOUT_UNDEFINED;
+		description.finalLayout = image.imported && !usedLater ? image.finalLayout : usageLayout(last.usage, image.format);
+		descriptions.push_back(description);
+
+		if (loadOp == VK_ATTACHMENT_LOAD_OP_CLEAR)
+			renderPass.clearValues[a] = first.clearValue;
+
+		// first use waits for whatever happened to the image or its memory before this render pass
+		addDependency(VK_SUBPASS_EXTERNAL, uses.front().subpass, EXTERNAL_STAGES, usageStage(first.usage),
+			EXTERNAL_ACCESS, usageAccess(first.usage), 0);
+
+		// uses inside render pass touch same pixel only
+		for (size_t u = 1; u < uses.size(); ++u) {
+			const Use& previous = *uses[u - 1].use;
+			const Use& next = *uses[u].use;
+			if (!isWrite(previous.usage) && !isWrite(next.usage))
+				continue;
+
+			addDependency(uses[u - 1].subpass, uses[u].subpass, usageStage(previous.usage), usageStage(next.usage),
+				usageAccess(previous.usage) & WRITE_ACCESS, usageAccess(next.usage), VK_DEPENDENCY_BY_REGION_BIT);
+		}
+
+		layouts[resource] = description.finalLayout;
+		stages[resource] = usageStage(last.usage);
+		accesses[resource] = usageAccess(last.usage);
+	}
+
+	// references of every subpass, kept alive until render pass is created
+	struct SubpassReferences {
+		std::vector<VkAttachmentReference> colors;
+		std::vector<VkAttachmentReference> inputs;
+		VkAttachmentReference depth = { VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED };
+		std::vector<uint32_t> preserves;
+	};
+
+	std::vector<SubpassReferences> references(renderPass.passes.size());
+	std::vector<VkSubpassDescription> subpasses(renderPass.passes.size());
+
+	for (uint32_t subpass = 0; subpass < renderPass.passes.size(); ++subpass) {
+		auto& refs = references[subpass];
+
+		for (const auto& use : passes_[renderPass.passes[subpass]].uses) {
+			if (use.usage == USAGE_SAMPLED)
+				continue;
+
+			VkAttachmentReference reference = { (uint32_t)attachmentIndex[use.resource],
+				usageLayout(use.usage, images_[use.resource].format) };
+
+			if (use.usage == USAGE_COLOR)
+				refs.colors.push_back(reference);
+			else if (use.usage == USAGE_DEPTH)
+				refs.depth = reference;
+			else
+				refs.inputs.push_back(reference);
+		}
+
+		// content used before and after this subpass must survive it
+		for (size_t a = 0; a < attachmentUses.size(); ++a) {
+			const auto& uses = attachmentUses[a];
+			bool usedHere = std::any_of(uses.begin(), uses.end(), [subpass](const AttachmentUse& u) { return u.subpass == subpass; });
+			if (!usedHere && uses.front().subpass < subpass && uses.back().subpass > subpass)
+				refs.preserves.push_back((uint32_t)a);
+		}
+
+		VkSubpassDescription& description = subpasses[subpass];
+		description.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		description.colorAttachmentCount = (uint32_t)refs.colors.size();
+		description.pColorAttachments = refs.colors.data();
+		description.inputAttachmentCount = (uint32_t)refs.inputs.size();
+		description.pInputAttachments = refs.inputs.data();
+		description.pDepthStencilAttachment = refs.depth.attachment != VK_ATTACHMENT_UNUSED ? &refs.depth : nullptr;
+		description.preserveAttachmentCount = (uint32_t)refs.preserves.size();
+		description.pPreserveAttachments = refs.preserves.data();
+	}
+
+	VkRenderPassCreateInfo createInfo = { };
+	createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	createInfo.attachmentCount = (uint32_t)descriptions.size();
+	createInfo.pAttachments = descriptions.data();
+	createInfo.subpassCount = (uint32_t)subpasses.size();
+	createInfo.pSubpasses = subpasses.data();
+	createInfo.dependencyCount = (uint32_t)dependencies.size();
+	createInfo.pDependencies = dependencies.data();
+
+	if (vkCreateRenderPass(device_, &createInfo, nullptr, &renderPass.handle) != VK_SUCCESS)
+		throw std::runtime_error("failed to create render pass");
+}
+
+void RenderGraph::createImages()
+{
+	std::vector<Resource> transients;
+	std::vector<VkMemoryRequirements> requirements(images_.size());
+
+	for (Resource i = 0; i < images_.size(); ++i) {
+		Image& image = images_[i];
+		if (image.imported || image.firstRenderPass < 0)
+			continue;
+
+		VkImageCreateInfo imageInfo = { };
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = image.format;
+		imageInfo.extent = { extent_.width, extent_.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = image.usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(device_, &imageInfo, nullptr, &image.image) != VK_SUCCESS)
+			throw std::runtime_error("failed to create image!");
+
+		vkGetImageMemoryRequirements(device_, image.image, &requirements[i]);
+		image.size = requirements[i].size;
+		transients.push_back(i);
+
+		++stats_.transientCount;
+		stats_.transientBytes += image.size;
+	}
+
+	// biggest first, each goes to first heap it fits in time and memory type; lazily allocated
+	// memory may never be committed at all, so sharing it gains nothing
+	std::sort(transients.begin(), transients.end(), [this](Resource a, Resource b) { return images_[a].size > images_[b].size; });
+
+	std::vector<VkMemoryRequirements> heapRequirements;
+	for (Resource resource : transients) {
+		Image& image = images_[resource];
+		const auto& imageRequirements = requirements[resource];
+		bool lazy = (image.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) && hasLazyMemory(imageRequirements.memoryTypeBits);
+
+		for (size_t h = 0; h < heaps_.size() && image.heap < 0 && !lazy; ++h) {
+			if (heaps_[h].properties != VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT ||
+				!(heapRequirements[h].memoryTypeBits & imageRequirements.memoryTypeBits))
+				continue;
+
+			bool overlaps = std::any_of(heaps_[h].images.begin(), heaps_[h].images.end(), [&](Resource other) {
+				return images_[other].firstRenderPass <= image.lastRenderPass && image.firstRenderPass <= images_[other].lastRenderPass;
+			});
+			if (overlaps)
+				continue;
+
+			image.heap = (int32_t)h;
+			heapRequirements[h].size = std::max(heapRequirements[h].size, imageRequirements.size);
+			heapRequirements[h].alignment = std::max(heapRequirements[h].alignment, imageRequirements.alignment);
+			heapRequirements[h].memoryTypeBits &= imageRequirements.memoryTypeBits;
+		}
+
+		if (image.heap < 0) {
+			image.heap = (int32_t)heaps_.size();
+			heaps_.emplace_back();
+			heapRequirements.push_back(imageRequirements);
+
+			if (lazy) {
+				heaps_.back().properties = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+				++stats_.lazyCount;
+			}
+		}
+
+		heaps_[image.heap].images.push_back(resource);
+	}
+
+	// every image of a heap starts at its beginning
+	for (size_t h = 0; h < heaps_.size(); ++h) {
+		heaps_[h].allocation = allocator_->allocate(heapRequirements[h], heaps_[h].properties, false);
+		stats_.heapBytes += heapRequirements[h].size;
+
+		for (Resource resource : heaps_[h].images) {
+			Image& image = images_[resource];
+			image.offset = heaps_[h].allocation.offset;
+			vkBindImageMemory(device_, image.image, heaps_[h].allocation.memory, image.offset);
+		}
+	}
+	stats_.heapCount = (uint32_t)heaps_.size();
+
+	for (Resource resource : transients) {
+		Image& image = images_[resource];
+
+		VkImageViewCreateInfo viewInfo = { };
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = image.format;
+		viewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		viewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		viewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+		viewInfo.subresourceRange.aspectMask = isDepthFormat(image.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(device_, &viewInfo, nullptr, &image.view) != VK_SUCCESS)
+			throw std::runtime_error("failed to create image view");
+	}
+}
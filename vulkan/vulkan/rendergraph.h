@@ -0,0 +1,187 @@
+#ifndef RENDERGRAPH_H_
+#define RENDERGRAPH_H_
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <functional>
+#include <ostream>
+#include "allocator.h"
+
+// Frame as a list of passes that declare which images they read and write; synchronization
+// is derived from the declarations instead of written by hand.
+// compile() drops passes whose results nobody uses, merges consecutive passes into subpasses
+// of one render pass (a pass sampling an image written in the current render pass starts
+// a new one), and derives load and store ops, layouts, subpass dependencies and barriers.
+// createTargets() makes transient images and framebuffers; transients whose lifetimes (in
+// render passes) don't overlap share memory, ones living in a single render pass get lazily
+// allocated memory where device has it.
+// Passes run in declaration order, which must be a valid order.
+class RenderGraph {
+public:
+	typedef uint32_t Resource;
+
+	// what record function of a pass gets, inheritance info for secondary buffers included
+	struct PassContext {
+		VkCommandBuffer commandBuffer;
+		VkRenderPass renderPass;
+		uint32_t subpass;
+		VkFramebuffer framebuffer;
+	};
+
+	typedef std::function<void(const PassContext&)> RecordFunction;
+
+	enum Usage {
+		USAGE_COLOR,		// color attachment
+		USAGE_DEPTH,		// depth attachment, tested and written
+		USAGE_INPUT,		// input attachment, pixel under fragment only, keeps passes in one render pass
+		USAGE_SAMPLED,		// sampled anywhere, writer must be in earlier render pass
+	};
+
+	struct Stats {
+		uint32_t passCount = 0;
+		uint32_t culledCount = 0;
+		uint32_t renderPassCount = 0;
+		uint32_t transientCount = 0;
+		uint32_t lazyCount = 0;					// in lazily allocated memory, never aliased
+		uint32_t heapCount = 0;					// memory blocks transients are placed in
+		VkDeviceSize transientBytes = 0;		// sum of transient image sizes
+		VkDeviceSize heapBytes = 0;				// memory actually allocated for them
+	};
+
+private:
+	struct Use {
+		Resource resource;
+		Usage usage;
+		VkAttachmentLoadOp loadOp;			// writes only, LOAD keeps earlier content
+		VkClearValue clearValue;
+	};
+
+	struct Pass {
+		std::string name;
+		RecordFunction record;
+		std::vector<Use> uses;
+		VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
+
+		// compiled
+		bool culled = false;
+		uint32_t renderPass = 0;
+		uint32_t subpass = 0;
+	};
+
+	struct Image {
+		std::string name;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		bool imported = false;
+		bool output = false;					// content stored for use after the graph
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;		// imported only
+		std::vector<VkImageView> views;			// imported only, one per framebuffer
+
+		// compiled
+		VkImageUsageFlags usage = 0;
+		int32_t firstRenderPass = -1;
+		int32_t lastRenderPass = -1;
+
+		// transient storage, made by createTargets
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		int32_t heap = -1;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+	};
+
+	// layout transition before render pass begins, for images sampled in it
+	struct Transition {
+		Resource resource;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+		VkPipelineStageFlags srcStage;
+		VkAccessFlags srcAccess;
+		VkPipelineStageFlags dstStage;
+		VkAccessFlags dstAccess;
+	};
+
+	struct RenderPass {
+		VkRenderPass handle = VK_NULL_HANDLE;
+		std::vector<uint32_t> passes;
+		std::vector<Resource> attachments;			// attachment index -> image
+		std::vector<VkClearValue> clearValues;
+		std::vector<Transition> transitions;
+		std::vector<VkFramebuffer> framebuffers;	// one per imported view
+	};
+
+	struct Heap {
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		Allocation allocation;
+		std::vector<Resource> images;
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	Allocator* allocator_ = nullptr;
+	VkExtent2D extent_ = { 0, 0 };
+
+	std::vector<Image> images_;
+	std::vector<Pass> passes_;
+	std::vector<RenderPass> renderPasses_;
+	std::vector<Heap> heaps_;
+	Stats stats_;
+
+private:
+	static bool isDepthFormat(VkFormat);
+	static bool isWrite(Usage usage) { return usage == USAGE_COLOR || usage == USAGE_DEPTH; }
+	static VkImageLayout usageLayout(Usage, VkFormat);
+	static VkPipelineStageFlags usageStage(Usage);
+	static VkAccessFlags usageAccess(Usage);
+
+	bool hasLazyMemory(uint32_t memoryTypeBits) const;
+	void use(uint32_t pass, Resource, Usage, VkAttachmentLoadOp, VkClearValue);
+	void cullPasses();
+	void groupPasses();
+	void createRenderPass(RenderPass&, std::vector<VkImageLayout>& layouts,
+		std::vector<VkPipelineStageFlags>& stages, std::vector<VkAccessFlags>& accesses);
+	void createImages();
+
+public:
+	RenderGraph() = default;
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+	~RenderGraph() { destroy(); }
+
+	// declaration, graph must not be compiled
+	Resource importImage(const std::string& name, VkFormat, VkImageLayout finalLayout);
+	Resource createImage(const std::string& name, VkFormat);
+	void markOutput(Resource);				// imported images always are
+
+	uint32_t addPass(const std::string& name, RecordFunction);
+	void addColorOutput(uint32_t pass, Resource, VkAttachmentLoadOp, VkClearColorValue clear = { });
+	void setDepthOutput(uint32_t pass, Resource, VkAttachmentLoadOp, float clearDepth = 1.0f);
+	void addInput(uint32_t pass, Resource);
+	void addTexture(uint32_t pass, Resource);
+
+	// creates render passes; throws if declarations can't be honored
+	void compile(VkDevice);
+
+	// extent dependent objects: transient images, their memory and framebuffers
+	void createTargets(Allocator*, VkExtent2D, const std::vector<std::vector<VkImageView>>& importedViews);
+
+	// hand objects over to returned function, so caller can destroy them once gpu is done;
+	// releaseTargets() keeps compiled graph, release() clears declarations too
+	std::function<void()> releaseTargets();
+	std::function<void()> release();
+	void destroy();		// device must be idle
+
+	// contents of pass's subpass, may change every frame
+	void setContents(uint32_t pass, VkSubpassContents contents) { passes_[pass].contents = contents; }
+	void execute(VkCommandBuffer, uint32_t framebufferIndex);
+
+	bool isCompiled() const { return !renderPasses_.empty(); }
+	bool isCulled(uint32_t pass) const { return passes_[pass].culled; }
+	VkRenderPass renderPass(uint32_t pass) const { return renderPasses_[passes_[pass].renderPass].handle; }
+	uint32_t subpass(uint32_t pass) const { return passes_[pass].subpass; }
+	VkImageView imageView(Resource resource) const { return images_[resource].view; }
+
+	Stats getStats() const { return stats_; }
+	void print(std::ostream&) const;
+};
+
+#endif // RENDERGRAPH_H_
@@ -0,0 +1,124 @@
+#include "shaderlibrary.h"
+#include "mappedfile.h"
+#include <stdexcept>
+
+const uint32_t ShaderLibrary::SPIRV_MAGIC;
+
+void ShaderLibrary::init(VkDevice device)
+{
+	device_ = device;
+}
+
+void ShaderLibrary::destroy()
+{
+	for (auto& module : modules_)
+		vkDestroyShaderModule(device_, module.second, nullptr);
+
+	modules_.clear();
+	files_.clear();
+}
+
+VkShaderModule ShaderLibrary::load(const std::string& path)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		auto file = files_.find(path);
+		if (file != files_.end()) {
+			++stats_.cacheHits;
+			return modules_.at(file->second);
+		}
+	}
+
+	uint64_t hash = 0;
+	VkShaderModule module = readModule(path, hash);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	files_[path] = hash;
+
+	return module;
+}
+
+bool ShaderLibrary::reload(const std::string& path, VkShaderModule& module)
+{
+	uint64_t hash = 0;
+	module = readModule(path, hash);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto file = files_.find(path);
+	bool changed = file == files_.end() || file->second != hash;
+	files_[path] = hash;
+
+	return changed;
+}
+
+VkShaderModule ShaderLibrary::create(const uint32_t* code, size_t size)
+{
+	if (size % sizeof(uint32_t) || size < 5 * sizeof(uint32_t) || code[0] != SPIRV_MAGIC)
+		throw std::runtime_error("not a SPIR-V module");
+
+	return getModule(code, size, hashCode(code, size));
+}
+
+ShaderLibrary::Stats ShaderLibrary::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+// private functions
+VkShaderModule ShaderLibrary::readModule(const std::string& path, uint64_t& hash)
+{
+	MappedFile file;
+	file.open(path);
+
+	// magic is checked in host byte order, vulkan doesn't take byte-swapped modules
+	const uint32_t* code = reinterpret_cast<const uint32_t*>(file.data());
+	if (file.size() % sizeof(uint32_t) || file.size() < 5 * sizeof(uint32_t) || code[0] != SPIRV_MAGIC)
+		throw std::runtime_error("not a SPIR-V module: " + path);
+
+	hash = hashCode(code, file.size());
+	VkShaderModule module = getModule(code, file.size(), hash);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	++stats_.filesRead;
+
+	return module;
+}
+
+VkShaderModule ShaderLibrary::getModule(const uint32_t* code, size_t size, uint64_t hash)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto it = modules_.find(hash);
+	if (it != modules_.end()) {
+		++stats_.cacheHits;
+		return it->second;
+	}
+
+	VkShaderModuleCreateInfo createInfo = { };
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = size;
+	createInfo.pCode = code;
+
+	VkShaderModule module = VK_NULL_HANDLE;
+	if (vkCreateShaderModule(device_, &createInfo, nullptr, &module) != VK_SUCCESS)
+		throw std::runtime_error("failed to create shader module!");
+
+	modules_[hash] = module;
+	++stats_.modulesCreated;
+
+	return module;
+}
+
+uint64_t ShaderLibrary::hashCode(const uint32_t* code, size_t size)
+{
+	// FNV-1a over words, size is mixed in so modules with zero tails don't collide
+	uint64_t hash = 14695981039346656037ull ^ size;
+	for (size_t i = 0; i < size / sizeof(uint32_t); ++i) {
+		hash ^= code[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
@@ -0,0 +1,53 @@
+#ifndef SHADERLIBRARY_H_
+#define SHADERLIBRARY_H_
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+
+// Shader modules created from SPIR-V files. Files are mapped instead of read, mapping
+// starts at page boundary, so code satisfies 4 byte alignment of pCode without a copy.
+// Modules are kept by hash of their code and files by path, so in one session no file
+// is read and no module is created twice, unless reload() is asked to read it again.
+// Modules live until destroy(), methods can be called from any thread.
+class ShaderLibrary {
+public:
+	struct Stats {
+		uint32_t filesRead = 0;
+		uint32_t modulesCreated = 0;
+		uint32_t cacheHits = 0;			// loads served without reading or creating anything
+	};
+
+private:
+	VkDevice device_ = VK_NULL_HANDLE;
+
+	std::unordered_map<uint64_t, VkShaderModule> modules_;		// by code hash
+	std::unordered_map<std::string, uint64_t> files_;			// path -> code hash
+
+	Stats stats_;
+	std::mutex mutex_;
+
+	static const uint32_t SPIRV_MAGIC = 0x07230203;
+
+private:
+	VkShaderModule readModule(const std::string& path, uint64_t& hash);
+	VkShaderModule getModule(const uint32_t* code, size_t size, uint64_t hash);
+
+	static uint64_t hashCode(const uint32_t* code, size_t size);
+
+public:
+	void init(VkDevice);
+	void destroy();
+
+	// throws if file is missing or isn't SPIR-V
+	VkShaderModule load(const std::string& path);
+	VkShaderModule create(const uint32_t* code, size_t size);
+
+	// read file even if it was loaded before, returns true if its code changed since then
+	bool reload(const std::string& path, VkShaderModule& module);
+
+	Stats getStats();
+};
+
+#endif // SHADERLIBRARY_H_
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Shader build step for platforms without the Visual Studio projects: writes the same spv
+# files the projects' glslangValidator steps do. Run it after changing a shader, e.g.
+#   shaders/compile.sh
+# VULKAN_SDK picks the compiler of that SDK, otherwise glslangValidator is taken from PATH.
+set -e
+
+cd "$(dirname "$0")"
+compiler="${VULKAN_SDK:+$VULKAN_SDK/bin/}glslangValidator"
+
+build() {
+	# only when spv is missing or older than its source
+	if [ ! -f "$2" ] || [ "$1" -nt "$2" ]; then
+		"$compiler" -V "$1" -o "$2"
+	fi
+}
+
+build shader.vert vert.spv
+build shader.frag frag.spv
+build particles.comp particles.spv
+build cull.comp cull.spv
+build post.vert postvert.spv
+build post.frag postfrag.spv
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// scene color of the same pixel, written by previous subpass
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput sceneColor;
+
+layout(location = 0) in vec2 fragUv;
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+	vec4 color = subpassLoad(sceneColor);
+
+	// vignette
+	vec2 d = fragUv - 0.5;
+	color.rgb *= 1.0 - dot(d, d) * 1.2;
+
+	outColor = color;
+}
@@ -0,0 +1,15 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) out vec2 fragUv;
+
+out gl_PerVertex {
+	vec4 gl_Position;
+};
+
+// one triangle covering the screen, no vertex buffer
+void main()
+{
+	fragUv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4(fragUv * 2.0 - 1.0, 0.0, 1.0);
+}
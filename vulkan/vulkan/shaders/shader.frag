@@ -1,10 +1,20 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// set per pipeline variant, see PipelineKey
+layout(constant_id = 0) const int COLOR_MODE = 0;	// 0 - vertex color, 1 - luminance, 2 - inverted
+layout(constant_id = 1) const float ALPHA = 1.0;
+
 layout(location = 0) in vec3 fragColor;
 layout(location = 0) out vec4 outColor;
 
 void main()
 {
-	outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+	vec3 color = fragColor;
+	if (COLOR_MODE == 1)
+		color = vec3(dot(color, vec3(0.299, 0.587, 0.114)));
+	else if (COLOR_MODE == 2)
+		color = vec3(1.0) - color;
+
+	outColor = vec4(color, ALPHA);
+}
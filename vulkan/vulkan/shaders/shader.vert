@@ -4,14 +4,26 @@
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
 
+// per instance
+layout(location = 2) in vec4 instanceTransform;	// xy - offset, z - scale, w - rotation
+layout(location = 3) in vec4 instanceColor;
+
 layout(location = 0) out vec3 fragColor;
 
+layout(push_constant) uniform DrawConstants {
+	float depth;		// 0 - nearest
+} draw;
+
 out gl_PerVertex {
 	vec4 gl_Position;
 };
 
 void main()
 {
-	gl_Position = vec4(inPosition, 0.0, 1.0);
-	fragColor = inColor;
+	float c = cos(instanceTransform.w);
+	float s = sin(instanceTransform.w);
+	vec2 position = mat2(c, s, -s, c) * inPosition * instanceTransform.z + instanceTransform.xy;
+
+	gl_Position = vec4(position, draw.depth, 1.0);
+	fragColor = inColor * instanceColor.rgb;
 }
\ No newline at end of file
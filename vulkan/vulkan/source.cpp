@@ -1,20 +1,99 @@
 #include "vulkanapp.h"
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#ifdef _WIN32
 #include <conio.h>
+#endif
 
-int main()
+// keep console open after window is closed, headless runs exit right away
+static void waitKey(const VulkanApp::Options& options)
 {
-	VulkanApp app;
+#ifdef _WIN32
+	if (!options.headless)
+		_getch();
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+	VulkanApp::Options options;
+	std::string bakeFile;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--headless") == 0)
+			options.headless = true;
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			options.frameCount = (uint32_t)std::atoi(argv[++i]);
+		else if (strcmp(argv[i], "--present") == 0 && i + 1 < argc) {
+			std::string profile = argv[++i];
+			if (profile == "latency")
+				options.presentProfile = VulkanApp::PRESENT_LOW_LATENCY;
+			else if (profile == "vsync")
+				options.presentProfile = VulkanApp::PRESENT_VSYNC;
+			else
+				options.presentProfile = VulkanApp::PRESENT_THROUGHPUT;
+		}
+		else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+			options.framesInFlight = (uint32_t)std::atoi(argv[++i]);
+		else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+			options.streamTriangles = (uint32_t)std::atoi(argv[++i]);
+		else if (strcmp(argv[i], "--draws") == 0 && i + 1 < argc)
+			options.drawCount = (uint32_t)std::atoi(argv[++i]);
+		else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+			options.meshFile = argv[++i];
+		else if (strcmp(argv[i], "--bake") == 0 && i + 1 < argc)
+			bakeFile = argv[++i];
+		else if (strcmp(argv[i], "--compact") == 0)
+			options.compactVertices = true;
+		else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc)
+			options.indexBits = (uint32_t)std::atoi(argv[++i]);
+		else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+			options.instanceCount = (uint32_t)std::atoi(argv[++i]);
+		else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc)
+			options.particleCount = (uint32_t)std::atoi(argv[++i]);
+		else if (strcmp(argv[i], "--cull") == 0 && i + 1 < argc)
+			options.cullObjects = (uint32_t)std::atoi(argv[++i]);
+		else if (strcmp(argv[i], "--post") == 0)
+			options.postProcess = true;
+		else if (strcmp(argv[i], "--variant") == 0 && i + 1 < argc)
+			options.pipelineVariant = (uint32_t)std::atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			options.recordThreads = (uint32_t)std::atoi(argv[++i]);
+		else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc)
+			options.telemetryFile = argv[++i];
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			options.traceFile = argv[++i];
+		else if (strcmp(argv[i], "--watch") == 0)
+			options.watchShaders = true;
+		else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+			options.deviceName = argv[++i];
+	}
+
+	// write built-in mesh in layout chosen by --compact and --index, then exit
+	if (!bakeFile.empty()) {
+		try {
+			MeshAsset::bake(bakeFile, vertices, indices, options.compactVertices, options.indexBits);
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return -1;
+		}
+
+		return 0;
+	}
+
+	VulkanApp app(options);
 
 	try {
 		app.run();
 	}
 	catch (const std::exception& e) {
 		std::cerr << e.what() << std::endl;
-		_getch();
+		waitKey(options);
 		return -1;
 	}
 
-	_getch();
+	waitKey(options);
 	return 0;
 }
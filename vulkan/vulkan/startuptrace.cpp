@@ -0,0 +1,79 @@
+#include "startuptrace.h"
+#include <stdexcept>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+void StartupTrace::start()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	start_ = Clock::now();
+	spans_.clear();
+	threads_.clear();
+}
+
+void StartupTrace::add(const char* name, Clock::time_point begin, Clock::time_point end)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// small stable thread numbers read better than hashed ids
+	auto id = std::this_thread::get_id();
+	auto thread = std::find(threads_.begin(), threads_.end(), id);
+	if (thread == threads_.end())
+		thread = threads_.insert(threads_.end(), id);
+
+	Span span;
+	span.name = name;
+	span.thread = (uint32_t)(thread - threads_.begin());
+	span.start = std::chrono::duration<double, std::milli>(begin - start_).count();
+	span.duration = std::chrono::duration<double, std::milli>(end - begin).count();
+	spans_.push_back(span);
+}
+
+double StartupTrace::elapsed() const
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start_).count();
+}
+
+std::vector<StartupTrace::Span> StartupTrace::spans()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// scopes close inner first, order by start instead
+	auto spans = spans_;
+	std::stable_sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) { return a.start < b.start; });
+
+	return spans;
+}
+
+void StartupTrace::print(std::ostream& out)
+{
+	out << "Startup phases (ms)\n" << std::fixed << std::setprecision(2)
+		<< std::setw(10) << "start" << std::setw(10) << "time" << std::setw(8) << "thread" << "  phase\n";
+
+	for (const auto& span : spans()) {
+		out << std::setw(10) << span.start << std::setw(10) << span.duration
+			<< std::setw(8) << span.thread << "  " << span.name << '\n';
+	}
+
+	out << std::endl;
+}
+
+void StartupTrace::save(const std::string& path)
+{
+	std::ofstream file(path, std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+		throw std::runtime_error("failed to open trace file " + path);
+
+	// complete events, timestamps in us
+	file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+
+	auto spans = this->spans();
+	for (size_t i = 0; i < spans.size(); ++i) {
+		file << "{\"name\":\"" << spans[i].name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << spans[i].thread
+			<< ",\"ts\":" << spans[i].start * 1000.0 << ",\"dur\":" << spans[i].duration * 1000.0 << "}"
+			<< (i + 1 < spans.size() ? ",\n" : "\n");
+	}
+
+	file << "]}\n";
+}
@@ -0,0 +1,55 @@
+#ifndef STARTUPTRACE_H_
+#define STARTUPTRACE_H_
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <ostream>
+
+// Timed spans of startup phases, recorded from any thread.
+// print() gives a table sorted by start time, save() writes chrome://tracing json
+// (also opened by Perfetto), where overlapping phases show up on their own threads.
+class StartupTrace {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Span {
+		std::string name;
+		uint32_t thread = 0;		// 0 - first thread that recorded a span
+		double start = 0.0;			// ms since start()
+		double duration = 0.0;		// ms
+	};
+
+	// records span from construction to end of scope, trace may be null
+	class Scope {
+		StartupTrace* trace_;
+		const char* name_;
+		Clock::time_point start_;
+
+	public:
+		Scope(StartupTrace* trace, const char* name) : trace_(trace), name_(name), start_(Clock::now()) { }
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+		~Scope() { if (trace_) trace_->add(name_, start_, Clock::now()); }
+	};
+
+private:
+	Clock::time_point start_ = Clock::now();
+	std::mutex mutex_;
+	std::vector<Span> spans_;
+	std::vector<std::thread::id> threads_;
+
+public:
+	void start();
+	void add(const char* name, Clock::time_point begin, Clock::time_point end);
+
+	double elapsed() const;		// ms since start()
+	std::vector<Span> spans();
+
+	void print(std::ostream&);
+	void save(const std::string& path);
+};
+
+#endif // STARTUPTRACE_H_
@@ -0,0 +1,134 @@
+#include "streambuffer.h"
+#include <stdexcept>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+void StreamBuffer::init(VkPhysicalDevice physicalDevice, VkDevice device, Allocator* allocator,
+	VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags usage)
+{
+	device_ = device;
+	allocator_ = allocator;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	atomSize_ = properties.limits.nonCoherentAtomSize ? properties.limits.nonCoherentAtomSize : 1;
+
+	// every region starts at atom boundary, so its flush range never touches neighbours
+	frameSize_ = alignUp(frameSize, atomSize_);
+	frameCount_ = frameCount;
+
+	VkBufferCreateInfo bufferInfo = { };
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = frameSize_ * frameCount_;
+	bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(device_, &bufferInfo, nullptr, &hostBuffer_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create stream buffer!");
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(device_, hostBuffer_, &memoryRequirements);
+
+	// prefer memory both sides can see (BAR or unified memory), then gpu reads writes in place
+	const auto& memoryProperties = allocator_->memoryProperties();
+	VkMemoryPropertyFlags directFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+
+	direct_ = false;
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+		if (memoryRequirements.memoryTypeBits & (1 << i) &&
+			(memoryProperties.memoryTypes[i].propertyFlags & directFlags) == directFlags)
+			direct_ = true;
+	}
+
+	hostAllocation_ = allocator_->allocate(memoryRequirements,
+		direct_ ? directFlags : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, true);
+	vkBindBufferMemory(device_, hostBuffer_, hostAllocation_.memory, hostAllocation_.offset);
+
+	coherent_ = (memoryProperties.memoryTypes[hostAllocation_.memoryType].propertyFlags &
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+	if (!direct_) {
+		bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		allocator_->createBuffer(bufferInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, deviceBuffer_, deviceAllocation_);
+	}
+
+	beginFrame(0);
+}
+
+void StreamBuffer::destroy()
+{
+	if (!device_)
+		return;
+
+	allocator_->destroyBuffer(deviceBuffer_, deviceAllocation_);
+	allocator_->destroyBuffer(hostBuffer_, hostAllocation_);
+
+	device_ = VK_NULL_HANDLE;
+}
+
+void StreamBuffer::beginFrame(uint32_t frameIndex)
+{
+	frameOffset_ = frameSize_ * (frameIndex % frameCount_);
+	used_ = 0;
+	flushed_ = 0;
+}
+
+void* StreamBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	VkDeviceSize start = alignUp(used_, alignment ? alignment : 1);
+	if (start + size > frameSize_)
+		throw std::runtime_error("stream buffer frame region is full");
+
+	used_ = start + size;
+	offset = frameOffset_ + start;
+
+	return static_cast<char*>(hostAllocation_.mapped) + offset;
+}
+
+void StreamBuffer::flush()
+{
+	if (coherent_ || used_ == flushed_)
+		return;
+
+	// range must start and end on atom boundary, region size is multiple of atom
+	VkDeviceSize begin = flushed_ / atomSize_ * atomSize_;
+	VkDeviceSize end = alignUp(used_, atomSize_);
+
+	VkMappedMemoryRange range = { };
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = hostAllocation_.memory;
+	range.offset = hostAllocation_.offset + frameOffset_ + begin;
+	range.size = end - begin;
+
+	vkFlushMappedMemoryRanges(device_, 1, &range);
+	flushed_ = used_;
+}
+
+void StreamBuffer::record(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	if (direct_ || used_ == 0)
+		return;
+
+	VkBufferCopy copyRegion = { };
+	copyRegion.srcOffset = frameOffset_;
+	copyRegion.dstOffset = frameOffset_;
+	copyRegion.size = used_;
+
+	vkCmdCopyBuffer(commandBuffer, hostBuffer_, deviceBuffer_, 1, &copyRegion);
+
+	VkBufferMemoryBarrier barrier = { };
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = deviceBuffer_;
+	barrier.offset = frameOffset_;
+	barrier.size = used_;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+		0, nullptr, 1, &barrier, 0, nullptr);
+}
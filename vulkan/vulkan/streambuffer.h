@@ -0,0 +1,53 @@
+#ifndef STREAMBUFFER_H_
+#define STREAMBUFFER_H_
+
+#include <vulkan/vulkan.h>
+#include "allocator.h"
+
+// Ring buffer for data rewritten every frame, split in one region per frame in flight.
+// Region of frame slot may be overwritten once fence of that slot was waited on.
+// Device local host visible memory (BAR) is written in place and read by gpu directly,
+// otherwise data is written to host memory and record() copies it to device local buffer.
+class StreamBuffer {
+	VkDevice device_ = VK_NULL_HANDLE;
+	Allocator* allocator_ = nullptr;
+	VkDeviceSize atomSize_ = 1;				// nonCoherentAtomSize, flushed ranges are aligned to it
+	bool coherent_ = true;
+	bool direct_ = false;					// gpu reads mapped memory itself, no copy is needed
+
+	VkBuffer hostBuffer_ = VK_NULL_HANDLE;			// mapped ring
+	Allocation hostAllocation_;
+	VkBuffer deviceBuffer_ = VK_NULL_HANDLE;		// copy target when mapped memory isn't device local
+	Allocation deviceAllocation_;
+
+	VkDeviceSize frameSize_ = 0;
+	uint32_t frameCount_ = 0;
+
+	// region of current frame
+	VkDeviceSize frameOffset_ = 0;
+	VkDeviceSize used_ = 0;
+	VkDeviceSize flushed_ = 0;
+
+public:
+	void init(VkPhysicalDevice, VkDevice, Allocator*, VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags);
+	void destroy();
+
+	// start writing region of frame slot, previous content of it is dropped
+	void beginFrame(uint32_t frameIndex);
+
+	// reserve size bytes in current region, returns address to write to and
+	// offset in buffer() to bind. Throws if region is full
+	void* allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+
+	// make writes visible to gpu, needed for non-coherent memory only
+	void flush();
+
+	// copy current region to device local buffer when memory isn't read directly
+	void record(VkCommandBuffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	VkBuffer buffer() const { return direct_ ? hostBuffer_ : deviceBuffer_; }
+	bool isDirect() const { return direct_; }
+	VkDeviceSize frameSize() const { return frameSize_; }
+};
+
+#endif // STREAMBUFFER_H_
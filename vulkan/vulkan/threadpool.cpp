@@ -0,0 +1,96 @@
+#include "threadpool.h"
+#include <algorithm>
+
+void ThreadPool::init(uint32_t threadCount)
+{
+	destroy();
+
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	stop_ = false;
+	for (uint32_t i = 0; i < threadCount; ++i)
+		threads_.emplace_back(&ThreadPool::worker, this, i);
+}
+
+void ThreadPool::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	wake_.notify_all();
+
+	for (auto& thread : threads_)
+		thread.join();
+	threads_.clear();
+}
+
+void ThreadPool::parallelFor(uint32_t taskCount, const std::function<void(uint32_t task, uint32_t thread)>& job)
+{
+	if (taskCount == 0)
+		return;
+
+	if (threads_.empty()) {
+		for (uint32_t i = 0; i < taskCount; ++i)
+			job(i, 0);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	job_ = &job;
+	taskCount_ = taskCount;
+	nextTask_ = 0;
+	finishedTasks_ = 0;
+	error_ = nullptr;
+	++generation_;
+
+	wake_.notify_all();
+	done_.wait(lock, [this] { return finishedTasks_ == taskCount_; });
+
+	job_ = nullptr;
+	taskCount_ = 0;
+
+	if (error_) {
+		auto error = error_;
+		error_ = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+// private functions
+void ThreadPool::worker(uint32_t index)
+{
+	uint64_t generation = 0;
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	for (;;) {
+		wake_.wait(lock, [&] { return stop_ || generation_ != generation; });
+		if (stop_)
+			return;
+
+		generation = generation_;
+
+		// tasks are pulled one by one, so faster workers take more of them
+		while (nextTask_ < taskCount_) {
+			uint32_t task = nextTask_++;
+			auto job = job_;
+			lock.unlock();
+
+			std::exception_ptr error;
+			try {
+				(*job)(task, index);
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+
+			lock.lock();
+			if (error && !error_)
+				error_ = error;
+
+			if (++finishedTasks_ == taskCount_)
+				done_.notify_all();
+		}
+	}
+}
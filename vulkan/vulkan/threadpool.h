@@ -0,0 +1,49 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+// Fixed set of worker threads running batches of indexed tasks.
+// parallelFor() hands out tasks to workers and blocks until all of them are done,
+// job gets task index and index of the worker running it (stable, below threadCount()).
+class ThreadPool {
+	std::vector<std::thread> threads_;
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable done_;
+
+	const std::function<void(uint32_t, uint32_t)>* job_ = nullptr;
+	uint32_t taskCount_ = 0;
+	uint32_t nextTask_ = 0;
+	uint32_t finishedTasks_ = 0;
+	uint64_t generation_ = 0;
+	bool stop_ = false;
+	std::exception_ptr error_;
+
+private:
+	void worker(uint32_t index);
+
+public:
+	ThreadPool() = default;
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool() { destroy(); }
+
+	// 0 threads - hardware concurrency
+	void init(uint32_t threadCount);
+	void destroy();
+
+	// at least 1, without workers tasks run on calling thread as worker 0
+	uint32_t threadCount() const { return threads_.empty() ? 1 : (uint32_t)threads_.size(); }
+
+	// first exception thrown by a task is rethrown here
+	void parallelFor(uint32_t taskCount, const std::function<void(uint32_t task, uint32_t thread)>& job);
+};
+
+#endif // THREADPOOL_H_
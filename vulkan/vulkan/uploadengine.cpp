@@ -0,0 +1,275 @@
+#include "uploadengine.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+const VkDeviceSize UploadEngine::STAGING_CHUNK_SIZE;
+
+void UploadEngine::init(VkDevice device, Allocator* allocator, VkQueue queue, uint32_t queueFamily, uint32_t graphicFamily)
+{
+	device_ = device;
+	allocator_ = allocator;
+	queue_ = queue;
+	queueFamily_ = queueFamily;
+	graphicFamily_ = graphicFamily;
+
+	VkCommandPoolCreateInfo createInfo = { };
+	createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	createInfo.queueFamilyIndex = queueFamily_;
+
+	if (vkCreateCommandPool(device_, &createInfo, nullptr, &commandPool_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create upload command pool");
+}
+
+void UploadEngine::destroy()
+{
+	if (!device_)
+		return;
+
+	waitIdle();
+
+	for (auto& upload : pending_)
+		allocator_->destroyBuffer(upload.stagingBuffer, upload.stagingAllocation);
+	pending_.clear();
+
+	for (auto& batch : freeBatches_) {
+		vkDestroyFence(device_, batch.fence, nullptr);
+		vkDestroySemaphore(device_, batch.semaphore, nullptr);
+	}
+	freeBatches_.clear();
+
+	if (commandPool_) {
+		vkDestroyCommandPool(device_, commandPool_, nullptr);
+		commandPool_ = VK_NULL_HANDLE;
+	}
+
+	device_ = VK_NULL_HANDLE;
+}
+
+void UploadEngine::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	for (VkDeviceSize chunkOffset = 0; chunkOffset < size; chunkOffset += STAGING_CHUNK_SIZE) {
+		Upload upload;
+		upload.dstBuffer = dstBuffer;
+		upload.dstOffset = dstOffset + chunkOffset;
+		upload.size = std::min(size - chunkOffset, STAGING_CHUNK_SIZE);
+		upload.dstStage = dstStage;
+		upload.dstAccess = dstAccess;
+
+		VkBufferCreateInfo bufferInfo = { };
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = upload.size;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		allocator_->createBuffer(bufferInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			upload.stagingBuffer, upload.stagingAllocation);
+
+		// data may be a file mapping, then this is where it's read from disk
+		memcpy(upload.stagingAllocation.mapped, bytes + chunkOffset, (size_t)upload.size);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_.push_back(std::move(upload));
+	}
+}
+
+uint64_t UploadEngine::flush()
+{
+	std::vector<Upload> uploads;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		uploads.swap(pending_);
+	}
+
+	if (uploads.empty())
+		return 0;
+
+	Batch batch = getBatch();
+	batch.id = nextBatchId_++;
+	batch.uploads = std::move(uploads);
+
+	VkCommandBufferBeginInfo beginInfo = { };
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkResetCommandBuffer(batch.commandBuffer, 0);
+	vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+
+	std::vector<VkBufferMemoryBarrier> barriers;
+	VkPipelineStageFlags dstStages = 0;
+
+	for (const auto& upload : batch.uploads) {
+		VkBufferCopy copyRegion = { };
+		copyRegion.dstOffset = upload.dstOffset;
+		copyRegion.size = upload.size;
+
+		vkCmdCopyBuffer(batch.commandBuffer, upload.stagingBuffer, upload.dstBuffer, 1, &copyRegion);
+
+		// on other family this is release half of ownership transfer, graphics queue does acquire
+		VkBufferMemoryBarrier barrier = { };
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = ownershipTransfer() ? 0 : upload.dstAccess;
+		barrier.srcQueueFamilyIndex = ownershipTransfer() ? queueFamily_ : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = ownershipTransfer() ? graphicFamily_ : VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = upload.dstBuffer;
+		barrier.offset = upload.dstOffset;
+		barrier.size = upload.size;
+		barriers.push_back(barrier);
+
+		dstStages |= upload.dstStage;
+	}
+
+	vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		ownershipTransfer() ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : dstStages, 0,
+		0, nullptr, (uint32_t)barriers.size(), barriers.data(), 0, nullptr);
+
+	if (vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("failed to record upload command buffer!");
+
+	// same queue as graphics needs no semaphore, submission order and barrier are enough
+	VkSubmitInfo submitInfo = { };
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
+	submitInfo.signalSemaphoreCount = ownershipTransfer() ? 1 : 0;
+	submitInfo.pSignalSemaphores = &batch.semaphore;
+
+	if (vkQueueSubmit(queue_, 1, &submitInfo, batch.fence) != VK_SUCCESS)
+		throw std::runtime_error("failed to submit upload command buffer!");
+
+	inFlight_.push_back(std::move(batch));
+
+	return inFlight_.back().id;
+}
+
+void UploadEngine::acquire(VkCommandBuffer commandBuffer, uint64_t frameNumber,
+	std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages)
+{
+	std::vector<VkBufferMemoryBarrier> barriers;
+	VkPipelineStageFlags dstStages = 0;
+
+	for (auto& batch : inFlight_) {
+		if (batch.acquired)
+			continue;
+
+		batch.acquired = true;
+		batch.acquireFrame = frameNumber;
+
+		if (!ownershipTransfer())
+			continue;
+
+		VkPipelineStageFlags batchStages = 0;
+		for (const auto& upload : batch.uploads) {
+			VkBufferMemoryBarrier barrier = { };
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = upload.dstAccess;
+			barrier.srcQueueFamilyIndex = queueFamily_;
+			barrier.dstQueueFamilyIndex = graphicFamily_;
+			barrier.buffer = upload.dstBuffer;
+			barrier.offset = upload.dstOffset;
+			barrier.size = upload.size;
+			barriers.push_back(barrier);
+
+			batchStages |= upload.dstStage;
+		}
+
+		waitSemaphores.push_back(batch.semaphore);
+		waitStages.push_back(batchStages);
+		dstStages |= batchStages;
+	}
+
+	if (!barriers.empty())
+		vkCmdPipelineBarrier(commandBuffer, dstStages, dstStages, 0, 0, nullptr,
+			(uint32_t)barriers.size(), barriers.data(), 0, nullptr);
+}
+
+void UploadEngine::collect(uint64_t completedFrameCount)
+{
+	// staging memory is free as soon as copy is done
+	for (auto& batch : inFlight_) {
+		if (batch.id <= completedBatchId_)
+			continue;
+
+		if (vkGetFenceStatus(device_, batch.fence) != VK_SUCCESS)
+			break;
+
+		completedBatchId_ = batch.id;
+		for (auto& upload : batch.uploads)
+			allocator_->destroyBuffer(upload.stagingBuffer, upload.stagingAllocation);
+	}
+
+	// semaphore is reusable only after frame that waited on it is done
+	while (!inFlight_.empty()) {
+		auto& batch = inFlight_.front();
+		if (batch.id > completedBatchId_ || !batch.acquired || batch.acquireFrame >= completedFrameCount)
+			break;
+
+		releaseBatch(batch);
+		inFlight_.pop_front();
+	}
+}
+
+void UploadEngine::waitIdle()
+{
+	vkQueueWaitIdle(queue_);
+
+	// nothing is pending on gpu anymore, every batch can go
+	for (auto& batch : inFlight_) {
+		for (auto& upload : batch.uploads)
+			allocator_->destroyBuffer(upload.stagingBuffer, upload.stagingAllocation);
+
+		completedBatchId_ = batch.id;
+		releaseBatch(batch);
+	}
+	inFlight_.clear();
+}
+
+// private functions
+UploadEngine::Batch UploadEngine::getBatch()
+{
+	if (!freeBatches_.empty()) {
+		Batch batch = std::move(freeBatches_.back());
+		freeBatches_.pop_back();
+		return batch;
+	}
+
+	Batch batch;
+
+	VkCommandBufferAllocateInfo allocInfo = { };
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = commandPool_;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	if (vkAllocateCommandBuffers(device_, &allocInfo, &batch.commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("failed to allocate upload command buffer!");
+
+	VkFenceCreateInfo fenceInfo = { };
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	VkSemaphoreCreateInfo semaphoreInfo = { };
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	if (vkCreateFence(device_, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS ||
+		vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &batch.semaphore) != VK_SUCCESS)
+		throw std::runtime_error("failed to create upload sync objects");
+
+	return batch;
+}
+
+void UploadEngine::releaseBatch(Batch& batch)
+{
+	vkResetFences(device_, 1, &batch.fence);
+
+	batch.uploads.clear();
+	batch.acquired = false;
+	batch.acquireFrame = 0;
+
+	freeBatches_.push_back(std::move(batch));
+}
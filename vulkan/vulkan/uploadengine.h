@@ -0,0 +1,85 @@
+#ifndef UPLOADENGINE_H_
+#define UPLOADENGINE_H_
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include "allocator.h"
+
+// Uploads buffer data without stalling graphics queue.
+// Copies are queued from any thread and submitted together by flush() on dedicated transfer queue
+// when device has one. Completion is tracked with fences, graphics queue waits on semaphore of
+// every batch and takes queue family ownership of destination buffers in acquire().
+// flush(), acquire() and collect() are called from render thread.
+class UploadEngine {
+	struct Upload {
+		VkBuffer dstBuffer = VK_NULL_HANDLE;
+		VkDeviceSize dstOffset = 0;
+		VkDeviceSize size = 0;
+		VkPipelineStageFlags dstStage = 0;		// where graphics queue uses the data first
+		VkAccessFlags dstAccess = 0;
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		Allocation stagingAllocation;
+	};
+
+	struct Batch {
+		uint64_t id = 0;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		std::vector<Upload> uploads;
+		bool acquired = false;
+		uint64_t acquireFrame = 0;			// frame whose submit waits on semaphore
+	};
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	Allocator* allocator_ = nullptr;
+	VkQueue queue_ = VK_NULL_HANDLE;
+	uint32_t queueFamily_ = 0;
+	uint32_t graphicFamily_ = 0;
+	VkCommandPool commandPool_ = VK_NULL_HANDLE;
+
+	std::vector<Upload> pending_;
+	std::deque<Batch> inFlight_;
+	std::vector<Batch> freeBatches_;
+
+	uint64_t nextBatchId_ = 1;
+	uint64_t completedBatchId_ = 0;
+
+	std::mutex mutex_;
+
+	// big uploads are split, so staging memory comes from allocator blocks
+	// instead of one dedicated allocation as large as the whole resource
+	static const VkDeviceSize STAGING_CHUNK_SIZE = 16 * 1024 * 1024;
+
+private:
+	bool ownershipTransfer() const { return queueFamily_ != graphicFamily_; }
+	Batch getBatch();
+	void releaseBatch(Batch&);
+
+public:
+	void init(VkDevice, Allocator*, VkQueue, uint32_t queueFamily, uint32_t graphicFamily);
+	void destroy();
+
+	// copy size bytes of data to staging memory and queue copy into dstBuffer
+	void uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	// submit everything queued so far as one batch, returns its id or 0 if nothing was queued
+	uint64_t flush();
+
+	// record ownership acquire for submitted batches into graphics command buffer
+	// and add their semaphores to the frame's wait list
+	void acquire(VkCommandBuffer, uint64_t frameNumber,
+		std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages);
+
+	// recycle batches that finished on transfer queue and were waited on by frames
+	// already known to be complete (frame numbers below completedFrameCount)
+	void collect(uint64_t completedFrameCount);
+
+	bool isComplete(uint64_t batchId) const { return batchId <= completedBatchId_; }
+	void waitIdle();
+};
+
+#endif // UPLOADENGINE_H_
@@ -0,0 +1,142 @@
+#ifndef VERTEXFORMAT_H_
+#define VERTEXFORMAT_H_
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Vertex layouts and their pipeline input descriptions. Vulkan format of every
+// attribute comes from the C++ type of its member, so description and struct
+// can't drift apart; unknown member type fails to compile.
+
+// normalized integers, shader reads them as floats
+struct Snorm16x2 {
+	int16_t x, y;
+};
+
+struct Unorm8x4 {
+	uint8_t r, g, b, a;
+};
+
+template<class T> struct AttributeFormat;
+
+template<> struct AttributeFormat<glm::vec2> { static const VkFormat value = VK_FORMAT_R32G32_SFLOAT; };
+template<> struct AttributeFormat<glm::vec3> { static const VkFormat value = VK_FORMAT_R32G32B32_SFLOAT; };
+template<> struct AttributeFormat<glm::vec4> { static const VkFormat value = VK_FORMAT_R32G32B32A32_SFLOAT; };
+template<> struct AttributeFormat<Snorm16x2> { static const VkFormat value = VK_FORMAT_R16G16_SNORM; };
+template<> struct AttributeFormat<Unorm8x4> { static const VkFormat value = VK_FORMAT_R8G8B8A8_UNORM; };
+
+template<class T> struct IndexFormat;
+
+template<> struct IndexFormat<uint16_t> { static const VkIndexType value = VK_INDEX_TYPE_UINT16; };
+template<> struct IndexFormat<uint32_t> { static const VkIndexType value = VK_INDEX_TYPE_UINT32; };
+
+struct Vertex {
+	glm::vec2 pos;
+	glm::vec3 color;
+};
+
+// 8 bytes instead of 20, position must lie in [-1, 1]
+struct CompactVertex {
+	Snorm16x2 pos;
+	Unorm8x4 color;
+};
+
+static_assert(sizeof(CompactVertex) == 8, "CompactVertex must stay 8 bytes");
+
+// per-instance attributes, read from second vertex binding once per instance
+struct InstanceData {
+	glm::vec4 transform;	// xy - offset, z - scale, w - rotation in radians
+	glm::vec4 color;		// multiplies vertex color
+};
+
+template<class Member>
+VkVertexInputAttributeDescription vertexAttribute(uint32_t binding, uint32_t location, size_t offset)
+{
+	VkVertexInputAttributeDescription description = { };
+	description.binding = binding;
+	description.location = location;
+	description.format = AttributeFormat<Member>::value;
+	description.offset = (uint32_t)offset;
+
+	return description;
+}
+
+#define VERTEX_ATTRIBUTE(type, member, binding, location) \
+	vertexAttribute<decltype(type::member)>(binding, location, offsetof(type, member))
+
+// attributes of vertex type in shader location order
+template<class V> struct VertexLayout;
+
+template<> struct VertexLayout<Vertex> {
+	static std::array<VkVertexInputAttributeDescription, 2> attributes(uint32_t binding, uint32_t firstLocation)
+	{
+		return { {
+			VERTEX_ATTRIBUTE(Vertex, pos, binding, firstLocation),
+			VERTEX_ATTRIBUTE(Vertex, color, binding, firstLocation + 1)
+		} };
+	}
+};
+
+// same locations as Vertex, so one shader reads both layouts
+template<> struct VertexLayout<CompactVertex> {
+	static std::array<VkVertexInputAttributeDescription, 2> attributes(uint32_t binding, uint32_t firstLocation)
+	{
+		return { {
+			VERTEX_ATTRIBUTE(CompactVertex, pos, binding, firstLocation),
+			VERTEX_ATTRIBUTE(CompactVertex, color, binding, firstLocation + 1)
+		} };
+	}
+};
+
+template<> struct VertexLayout<InstanceData> {
+	static std::array<VkVertexInputAttributeDescription, 2> attributes(uint32_t binding, uint32_t firstLocation)
+	{
+		return { {
+			VERTEX_ATTRIBUTE(InstanceData, transform, binding, firstLocation),
+			VERTEX_ATTRIBUTE(InstanceData, color, binding, firstLocation + 1)
+		} };
+	}
+};
+
+#undef VERTEX_ATTRIBUTE
+
+template<class V>
+VkVertexInputBindingDescription vertexBinding(uint32_t binding, VkVertexInputRate inputRate)
+{
+	VkVertexInputBindingDescription description = { };
+	description.binding = binding;
+	description.stride = sizeof(V);
+	description.inputRate = inputRate;
+
+	return description;
+}
+
+inline CompactVertex packVertex(const Vertex& vertex)
+{
+	auto snorm = [](float v) { return (int16_t)std::lround(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f); };
+	auto unorm = [](float v) { return (uint8_t)std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255.0f); };
+
+	CompactVertex packed;
+	packed.pos = { snorm(vertex.pos.x), snorm(vertex.pos.y) };
+	packed.color = { unorm(vertex.color.x), unorm(vertex.color.y), unorm(vertex.color.z), 255 };
+
+	return packed;
+}
+
+// lets code templated on vertex type write either layout
+inline void storeVertex(Vertex& dst, const Vertex& vertex)
+{
+	dst = vertex;
+}
+
+inline void storeVertex(CompactVertex& dst, const Vertex& vertex)
+{
+	dst = packVertex(vertex);
+}
+
+#endif // VERTEXFORMAT_H_
@@ -2,8 +2,18 @@
 #include <stdexcept>
 #include <vector>
 #include <iostream>		
-#include <fstream>
 #include <numeric>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
 
 VkResult CreateDebugReportCallbackEXT(VkInstance instance, 
 	const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, 
@@ -29,28 +39,49 @@ void DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT
 }
 
 
+VulkanApp::VulkanApp(const Options& options)
+	: options_(options)
+{
+	if (options_.framesInFlight == 0)
+		options_.framesInFlight = 1;
+
+	// particles or culled objects are the instances, cpu stream would be written for nothing
+	if (options_.particleCount || options_.cullObjects)
+		options_.instanceCount = 0;
+}
+
 void VulkanApp::initAppInfo()
 {
-	if (info_.enableValidationLayers)
+	if (info_.enableValidationLayers) {
 		info_.instanceLayers.push_back("VK_LAYER_LUNARG_standard_validation");
+		info_.instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+	}
+
+	// no surface to present to, so neither window nor swapchain extensions are needed
+	if (options_.headless) {
+		info_.deviceExtensions.clear();
+		return;
+	}
 
 	uint32_t extensionCount = 0;
 	auto extensions = glfwGetRequiredInstanceExtensions(&extensionCount);
 
 	for (uint32_t i = 0; i < extensionCount; ++i)
 		info_.instanceExtensions.push_back(*(extensions + i));
-	info_.instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 }
 
 void VulkanApp::run()
 {
-	initWindow();
+	trace_.start();
+
+	if (!options_.headless) {
+		StartupTrace::Scope span(&trace_, "window");
+		initWindow();
+	}
 	initAppInfo();		// rename function
 	initVulkan();
 
-	timer_.start();
-
-	showInfo();			// for help
+	telemetry_.start(options_.telemetryFile, 1.0, options_.verbose);
 
 	mainLoop();
 }
@@ -72,29 +103,76 @@ void VulkanApp::initWindow()
 
 void VulkanApp::initVulkan()
 {
-	createInstance();
+	auto step = [this](const char* name, void (VulkanApp::*function)()) {
+		StartupTrace::Scope span(&trace_, name);
+		(this->*function)();
+	};
 
-	if (info_.enableValidationLayers)
-		setupDebugCallback();
+	step("instance", &VulkanApp::createInstance);
 
-	createSurface();
-	pickPhysicalDevice();
-	createDevice();
-	
-	createSwapchain();
-	createRenderPass();
-	createGraphicsPipeline();
-	createFramebuffers();
-	createCommandPool();
-	createVertexBuffer();
-	createCommandBuffers();
-	createSemaphores();
+	if (info_.enableValidationLayers)
+		step("debug callback", &VulkanApp::setupDebugCallback);
+
+	if (!options_.headless)
+		step("surface", &VulkanApp::createSurface);
+	step("physical device", &VulkanApp::pickPhysicalDevice);
+	step("device", &VulkanApp::createDevice);
+	step("allocator", &VulkanApp::createAllocator);
+	step("upload engine", &VulkanApp::createUploadEngine);
+	step("thread pool", &VulkanApp::createThreadPool);
+
+	// file reads and shader modules overlap with swapchain creation, render graph needs only
+	// surface format, so pipelines don't wait for swapchain either
+	InitGraph graph;
+	auto pipelineCache = graph.add("pipeline cache", { }, [this] { createPipelineCache(); });
+	auto shaders = graph.add("shader modules", { }, [this] { createShaderLibrary(); });
+	auto mesh = graph.add("mesh", { }, [this] { loadMesh(); });
+	auto swapchain = graph.add("swapchain", { }, [this] {
+		if (options_.headless)
+			createOffscreenTargets();
+		else
+			createSwapchain();
+	});
+	auto renderGraph = graph.add("render graph", { }, [this] { createRenderGraph(); });
+	graph.add("pipelines", { pipelineCache, shaders, mesh, renderGraph }, [this] { createGraphicsPipeline(); });
+	graph.add("framebuffers", { swapchain, renderGraph }, [this] { createFramebuffers(); });
+	auto staticBuffers = graph.add("static buffers", { mesh }, [this] {
+		createVertexBuffer();
+		createIndexBuffer();
+		mesh_.close();
+	});
+	graph.add("particles", { pipelineCache, shaders }, [this] { createParticleSystem(); });
+	graph.add("gpu culling", { pipelineCache, shaders, staticBuffers }, [this] { createGpuCulling(); });
+	graph.run(&trace_);
+
+	if (options_.verbose)
+		renderGraph_.print(std::cout);
+
+	step("recorder", &VulkanApp::createRecorder);
+	step("profiler", &VulkanApp::createProfiler);
+	step("shader watcher", &VulkanApp::createShaderWatcher);
+	step("vertex stream", &VulkanApp::createVertexStream);
+	step("instance buffers", &VulkanApp::createInstanceBuffers);
+	step("frames", &VulkanApp::createFrames);
+
+	initEnd_ = StartupTrace::Clock::now();
 }
 
 void VulkanApp::createInstance()
 {
-	checkInstanceLayersSupport();
-	checkInstanceExtenstionsSupport();
+	capabilityCache_.load(info_.capabilityCacheFile);
+
+	// enumeration makes loader parse every layer manifest, skip it if same names passed before
+	std::vector<const char*> names = info_.instanceLayers;
+	names.push_back("|");		// layers end, extensions begin
+	names.insert(names.end(), info_.instanceExtensions.begin(), info_.instanceExtensions.end());
+	uint64_t instanceKey = CapabilityCache::hashNames(names);
+
+	bool cached = capabilityCache_.hasInstance(instanceKey);
+	if (!cached) {
+		checkInstanceLayersSupport();
+		checkInstanceExtenstionsSupport();
+	}
 
 	VkApplicationInfo appInfo = { };
 	appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -112,8 +190,20 @@ void VulkanApp::createInstance()
 	createInfo.enabledExtensionCount = info_.instanceExtensions.size();
 	createInfo.ppEnabledExtensionNames = info_.instanceExtensions.data();
 
-	if (vkCreateInstance(&createInfo, nullptr, &instance_) != VK_SUCCESS)
+	VkResult result = vkCreateInstance(&createInfo, nullptr, &instance_);
+
+	// something was uninstalled since checks were cached, full checks name what is missing
+	if (cached && (result == VK_ERROR_LAYER_NOT_PRESENT || result == VK_ERROR_EXTENSION_NOT_PRESENT)) {
+		capabilityCache_.clear();
+		capabilityCache_.save();
+		checkInstanceLayersSupport();
+		checkInstanceExtenstionsSupport();
+	}
+
+	if (result != VK_SUCCESS)
 		throw std::runtime_error("failed to create instance");
+
+	capabilityCache_.setInstance(instanceKey);
 }
 
 void VulkanApp::pickPhysicalDevice()
@@ -127,13 +217,28 @@ void VulkanApp::pickPhysicalDevice()
 	std::vector<VkPhysicalDevice> physicalDevices(physicalDeviceCount);
 	vkEnumeratePhysicalDevices(instance_, &physicalDeviceCount, physicalDevices.data());
 
+	uint64_t deviceKey = CapabilityCache::hashNames(info_.deviceExtensions);
+
 	for (const auto& device : physicalDevices) {
-		if (checkDeviceExtensionSupport(device)) {
-			auto familyIndices = getFamilyIndices(device);
-			if (familyIndices.graphicFamily >= 0 && familyIndices.presentFamily >= 0) {
-				physicalDevice_ = device;
-				return;
-			}
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(device, &properties);
+
+		// lets benchmark pick software or hardware implementation
+		if (!options_.deviceName.empty() && std::string(properties.deviceName).find(options_.deviceName) == std::string::npos)
+			continue;
+
+		// same device and driver had the extensions last run
+		if (!capabilityCache_.hasDevice(deviceKey, properties) && !checkDeviceExtensionSupport(device))
+			continue;
+
+		// surface support can change between runs, so families are always looked up, but only here
+		auto familyIndices = getFamilyIndices(device);
+		if (familyIndices.graphicFamily >= 0 && familyIndices.presentFamily >= 0) {
+			physicalDevice_ = device;
+			deviceProperties_ = properties;
+			familyIndices_ = familyIndices;
+			capabilityCache_.setDevice(deviceKey, properties);
+			return;
 		}
 	}
 
@@ -146,7 +251,7 @@ void VulkanApp::createDevice()
 	float queuePripority = 1.0f;
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 
-	auto familyIndices = getFamilyIndices(physicalDevice_);
+	const auto& familyIndices = familyIndices_;
 	VkDeviceQueueCreateInfo deviceGraphicQueueCreateInfo = {};
 	deviceGraphicQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 	deviceGraphicQueueCreateInfo.queueFamilyIndex = (uint32_t)familyIndices.graphicFamily;
@@ -163,20 +268,72 @@ void VulkanApp::createDevice()
 		queueCreateInfos.push_back(devicePresentQueueCreateInfo);
 	}
 
+	if (familyIndices.transferFamily >= 0) {
+		VkDeviceQueueCreateInfo deviceTransferQueueCreateInfo = { };
+		deviceTransferQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		deviceTransferQueueCreateInfo.queueFamilyIndex = (uint32_t)familyIndices.transferFamily;
+		deviceTransferQueueCreateInfo.queueCount = 1;
+		deviceTransferQueueCreateInfo.pQueuePriorities = &queuePripority;
+		queueCreateInfos.push_back(deviceTransferQueueCreateInfo);
+	}
+
+	if (familyIndices.computeFamily >= 0) {
+		VkDeviceQueueCreateInfo deviceComputeQueueCreateInfo = { };
+		deviceComputeQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		deviceComputeQueueCreateInfo.queueFamilyIndex = (uint32_t)familyIndices.computeFamily;
+		deviceComputeQueueCreateInfo.queueCount = 1;
+		deviceComputeQueueCreateInfo.pQueuePriorities = &queuePripority;
+		queueCreateInfos.push_back(deviceComputeQueueCreateInfo);
+	}
+
+	// profiler counts pipeline statistics, also around secondary buffers when device can
+	VkPhysicalDeviceFeatures supportedFeatures = { };
+	vkGetPhysicalDeviceFeatures(physicalDevice_, &supportedFeatures);
+
+	enabledFeatures_ = { };
+	enabledFeatures_.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+	enabledFeatures_.inheritedQueries = supportedFeatures.inheritedQueries;
+
+	// wireframe pipeline variants
+	enabledFeatures_.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+
+	// gpu culling draws objects through firstInstance, many records per indirect draw if it can
+	enabledFeatures_.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	enabledFeatures_.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
+	// with draw count culled records aren't even read, extension is optional
+	std::vector<const char*> extensions = info_.deviceExtensions;
+	drawIndirectCount_ = options_.cullObjects && hasDeviceExtension(physicalDevice_, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	if (drawIndirectCount_)
+		extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
 	VkDeviceCreateInfo deviceCreateInfo = { };
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceCreateInfo.queueCreateInfoCount = queueCreateInfos.size();
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 	deviceCreateInfo.enabledLayerCount = 0;			
-	deviceCreateInfo.enabledExtensionCount = info_.deviceExtensions.size();
-	deviceCreateInfo.ppEnabledExtensionNames = info_.deviceExtensions.data();
-	deviceCreateInfo.pEnabledFeatures = nullptr;
-
-	if (vkCreateDevice(physicalDevice_, &deviceCreateInfo, nullptr, &device_) != VK_SUCCESS)
+	deviceCreateInfo.enabledExtensionCount = extensions.size();
+	deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
+	deviceCreateInfo.pEnabledFeatures = &enabledFeatures_;
+
+	VkResult result = vkCreateDevice(physicalDevice_, &deviceCreateInfo, nullptr, &device_);
+	if (result != VK_SUCCESS) {
+		// extension check may have come from stale cache, next run checks for real
+		if (result == VK_ERROR_EXTENSION_NOT_PRESENT) {
+			capabilityCache_.clear();
+			capabilityCache_.save();
+		}
 		throw std::runtime_error("failed to create logical device");
+	}
+
+	capabilityCache_.save();
 
 	vkGetDeviceQueue(device_, familyIndices.graphicFamily, 0, &graphicQueue_);
 	vkGetDeviceQueue(device_, familyIndices.presentFamily, 0, &presentQueue_);
+	if (familyIndices.transferFamily >= 0)
+		vkGetDeviceQueue(device_, familyIndices.transferFamily, 0, &transferQueue_);
+	if (familyIndices.computeFamily >= 0)
+		vkGetDeviceQueue(device_, familyIndices.computeFamily, 0, &computeQueue_);
 }
 
 void VulkanApp::createSurface()
@@ -189,19 +346,34 @@ void VulkanApp::createSwapchain()
 {
 	auto capabilities = getSurfaceCapabilities();
 	auto format = getSurfaceFormat();
-	auto presentMode = getPresentMode();	
+	auto presentMode = getPresentMode();
+
+	// surface dictates extent unless it leaves it to us, framebuffers and viewport follow it
+	if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
+		info_.WIDTH = capabilities.currentExtent.width;
+		info_.HEIGHT = capabilities.currentExtent.height;
+	}
+	else {
+		// window size is in screen coordinates, which aren't pixels on high dpi displays
+		int width = 0, height = 0;
+		glfwGetFramebufferSize(window_, &width, &height);
+		info_.WIDTH = (int)std::max(capabilities.minImageExtent.width,
+			std::min(capabilities.maxImageExtent.width, (uint32_t)width));
+		info_.HEIGHT = (int)std::max(capabilities.minImageExtent.height,
+			std::min(capabilities.maxImageExtent.height, (uint32_t)height));
+	}
 
  	VkSwapchainCreateInfoKHR createInfo = { };
 	createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 	createInfo.surface = surface_;
-	createInfo.minImageCount = capabilities.minImageCount + 1;
+	createInfo.minImageCount = getImageCount(capabilities, presentMode);
 	createInfo.imageFormat = format.format;
 	createInfo.imageColorSpace = format.colorSpace;
-	createInfo.imageExtent = capabilities.currentExtent;	
+	createInfo.imageExtent = { (uint32_t)info_.WIDTH, (uint32_t)info_.HEIGHT };	
 	createInfo.imageArrayLayers = 1;						
 	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-	auto indices = getFamilyIndices(physicalDevice_);
+	const auto& indices = familyIndices_;
 	uint32_t familyIndeces[] = { (uint32_t)indices.graphicFamily, (uint32_t)indices.presentFamily };
 	if (indices.graphicFamily != indices.presentFamily) {
 		createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
@@ -256,59 +428,219 @@ void VulkanApp::createSwapchain()
 	}
 }
 
-void VulkanApp::createRenderPass()
+void VulkanApp::createOffscreenTargets()
 {
 	auto format = getSurfaceFormat();
 
-	VkAttachmentDescription colorAttachment = { };
-	colorAttachment.format = format.format;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-	VkAttachmentReference colorAttachmentRef = { };
-	colorAttachmentRef.attachment = 0;
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	VkSubpassDescription subpassDescription = { };
-	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpassDescription.colorAttachmentCount = 1;
-	subpassDescription.pColorAttachments = &colorAttachmentRef;
-
-	VkSubpassDependency subpassDependency = { };
-	subpassDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	subpassDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-	VkRenderPassCreateInfo createInfo = { };
-	createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	createInfo.attachmentCount = 1;
-	createInfo.pAttachments = &colorAttachment;
-	createInfo.subpassCount = 1;
-	createInfo.pSubpasses = &subpassDescription;
-	createInfo.dependencyCount = 1;
-	createInfo.pDependencies = &subpassDependency;
-
-	if (vkCreateRenderPass(device_, &createInfo, nullptr, &renderPass_) != VK_SUCCESS)
-		throw std::runtime_error("failed to create render pass");
+	// one image more than frames in flight, like minImageCount + 1 for swapchain
+	offscreenTargets_.resize(options_.framesInFlight + 1);
+	imageViews_.resize(offscreenTargets_.size(), VK_NULL_HANDLE);
+
+	for (size_t i = 0; i < offscreenTargets_.size(); ++i) {
+		createImage(info_.WIDTH, info_.HEIGHT, format.format, 
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, offscreenTargets_[i].image, offscreenTargets_[i].allocation);
+
+		VkImageViewCreateInfo imageViewCreateInfo = { };
+		imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		imageViewCreateInfo.image = offscreenTargets_[i].image;
+		imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageViewCreateInfo.format = format.format;
+		imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+		imageViewCreateInfo.subresourceRange.levelCount = 1;
+		imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+		imageViewCreateInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(device_, &imageViewCreateInfo, nullptr, &imageViews_[i]) != VK_SUCCESS)
+			throw std::runtime_error("failed to create image view");
+	}
+
+	nextOffscreenTarget_ = 0;
+}
+
+void VulkanApp::createRenderGraph()
+{
+	auto format = getSurfaceFormat();
+
+	// offscreen targets are left ready to be copied out
+	auto backbuffer = renderGraph_.importImage("backbuffer", format.format,
+		options_.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+	VkClearColorValue clearColor = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+	scenePass_ = renderGraph_.addPass("scene", [this](const RenderGraph::PassContext& context) { recordScene(context); });
+
+	// cleared and dropped in the same render pass, so it can stay in tile memory
+	depthFormat_ = getDepthFormat();
+	auto depth = renderGraph_.createImage("depth", depthFormat_);
+	renderGraph_.setDepthOutput(scenePass_, depth, VK_ATTACHMENT_LOAD_OP_CLEAR);
+
+	if (options_.postProcess) {
+		// post subpass reads only pixel under fragment, so on tilers scene color never leaves tile memory
+		sceneColor_ = renderGraph_.createImage("scene color", format.format);
+		renderGraph_.addColorOutput(scenePass_, sceneColor_, VK_ATTACHMENT_LOAD_OP_CLEAR, clearColor);
+
+		postPass_ = renderGraph_.addPass("post", [this](const RenderGraph::PassContext& context) { recordPost(context); });
+		renderGraph_.addInput(postPass_, sceneColor_);
+		renderGraph_.addColorOutput(postPass_, backbuffer, VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+	}
+	else {
+		renderGraph_.addColorOutput(scenePass_, backbuffer, VK_ATTACHMENT_LOAD_OP_CLEAR, clearColor);
+	}
+
+	renderGraph_.compile(device_);
+	renderPassFormat_ = format.format;
+
+	// layouts don't depend on render pass, they are created once
+	if (options_.postProcess && !postSetLayout_) {
+		VkDescriptorSetLayoutBinding binding = { };
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo setLayoutInfo = { };
+		setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		setLayoutInfo.bindingCount = 1;
+		setLayoutInfo.pBindings = &binding;
+
+		if (vkCreateDescriptorSetLayout(device_, &setLayoutInfo, nullptr, &postSetLayout_) != VK_SUCCESS)
+			throw std::runtime_error("failed to create descriptor set layout");
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = { };
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &postSetLayout_;
+
+		if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &postPipelineLayout_) != VK_SUCCESS)
+			throw std::runtime_error("failed to create pipeline layout!");
+	}
+}
+
+void VulkanApp::createAllocator()
+{
+	allocator_.init(physicalDevice_, device_);
+}
+
+void VulkanApp::createUploadEngine()
+{
+	// without dedicated transfer family uploads go through graphics queue
+	const auto& indices = familyIndices_;
+	if (indices.transferFamily >= 0)
+		uploadEngine_.init(device_, &allocator_, transferQueue_, indices.transferFamily, indices.graphicFamily);
+	else
+		uploadEngine_.init(device_, &allocator_, graphicQueue_, indices.graphicFamily, indices.graphicFamily);
+}
+
+void VulkanApp::createPipelineCache()
+{
+	pipelineCache_.create(physicalDevice_, device_, info_.pipelineCacheFile);
+}
+
+void VulkanApp::createShaderLibrary()
+{
+	shaderLibrary_.init(device_);
+
+	// file reads and module creation done ahead, pipelines find them in library
+	shaderLibrary_.load(info_.vertexFile);
+	shaderLibrary_.load(info_.fragmentFile);
+	if (options_.particleCount)
+		shaderLibrary_.load(info_.particleFile);
+	if (options_.cullObjects)
+		shaderLibrary_.load(info_.cullFile);
+	if (options_.postProcess) {
+		shaderLibrary_.load(info_.postVertexFile);
+		shaderLibrary_.load(info_.postFragmentFile);
+	}
 }
 
 void VulkanApp::createGraphicsPipeline()
 {
-	auto vertexShaderCode = readFile(info_.vertexFile);
-	auto fragmentShaderCode = readFile(info_.fragmentFile);
+	// layout doesn't depend on render pass, it is created once
+	if (!pipelineLayout_) {
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		// depth of current draw
+		VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(float) };
+
+		pipelineLayoutInfo.setLayoutCount = 0;
+		pipelineLayoutInfo.pSetLayouts = nullptr;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
+			throw std::runtime_error("failed to create pipeline layout!");
+	}
+
+	// read once per session, pipeline rebuilds reuse cached modules
+	VkShaderModule vertexShaderModule = shaderLibrary_.load(info_.vertexFile);
+	VkShaderModule fragmentShaderModule = shaderLibrary_.load(info_.fragmentFile);
+
+	if (!pipelineVariants_.size()) {
+		pipelineVariants_.declare(declarePipelineVariants());
+
+		if (options_.pipelineVariant >= pipelineVariants_.size())
+			throw std::runtime_error("pipeline variant " + std::to_string(options_.pipelineVariant) + " isn't declared");
+		activeVariant_ = options_.pipelineVariant;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	auto pipelines = pipelineVariants_.build(device_, &threadPool_,
+		[&](const PipelineKey& key, VkPipelineCreateFlags flags, VkPipeline basePipeline) {
+			return buildGraphicsPipeline(vertexShaderModule, fragmentShaderModule, key, flags, basePipeline);
+		});
+
+	// previous set exists only when render pass was rebuilt, frames in flight may still use it
+	for (auto pipeline : pipelineVariants_.replace(pipelines))
+		deferDestroy([this, pipeline] { vkDestroyPipeline(device_, pipeline, nullptr); });
+
+	std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+	pipelineTime_ = duration.count();
+	pipelineCacheWarm_ = pipelineCache_.isWarm();
+
+	if (options_.verbose)
+		std::cout << "Pipeline creation (" << pipelineVariants_.size() << " variants on " << threadPool_.threadCount()
+			<< " threads, " << (pipelineCacheWarm_ ? "warm" : "cold") << " cache): " << pipelineTime_ << " ms" << std::endl;
+
+	if (options_.postProcess)
+		createPostPipeline();
+}
 
-	VkShaderModule vertexShaderModule = VK_NULL_HANDLE;
-	VkShaderModule fragmentShaderModule = VK_NULL_HANDLE;
+// every combination of state the content uses, first one is base of the others
+std::vector<PipelineKey> VulkanApp::declarePipelineVariants()
+{
+	std::vector<VkPolygonMode> polygonModes = { VK_POLYGON_MODE_FILL };
+	if (enabledFeatures_.fillModeNonSolid)
+		polygonModes.push_back(VK_POLYGON_MODE_LINE);
+
+	std::vector<PipelineKey> keys;
+	for (auto polygonMode : polygonModes) {
+		for (VkCullModeFlags cullMode : { VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_NONE }) {
+			for (uint32_t blend : { PipelineKey::BLEND_OPAQUE, PipelineKey::BLEND_ALPHA, PipelineKey::BLEND_ADDITIVE }) {
+				for (uint32_t colorMode : { PipelineKey::COLOR_VERTEX, PipelineKey::COLOR_LUMINANCE, PipelineKey::COLOR_INVERTED }) {
+					PipelineKey key;
+					key.polygonMode = polygonMode;
+					key.cullMode = cullMode;
+					key.blend = blend;
+					key.colorMode = colorMode;
+					keys.push_back(key);
+				}
+			}
+		}
+	}
 
-	createShaderModule(vertexShaderCode, vertexShaderModule);
-	createShaderModule(fragmentShaderCode, fragmentShaderModule);
+	return keys;
+}
 
+// only reads state that stays fixed while pipeline compiler runs, so it is called from its thread too
+VkPipeline VulkanApp::buildGraphicsPipeline(VkShaderModule vertexShaderModule, VkShaderModule fragmentShaderModule,
+	const PipelineKey& key, VkPipelineCreateFlags flags, VkPipeline basePipeline)
+{
 	VkPipelineShaderStageCreateInfo vertexShaderStageCreateInfo = { };
 	vertexShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	vertexShaderStageCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
@@ -321,65 +653,73 @@ void VulkanApp::createGraphicsPipeline()
 	fragmentShaderStageCreateInfo.module = fragmentShaderModule;
 	fragmentShaderStageCreateInfo.pName = "main";
 
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageCreateInfo, fragmentShaderStageCreateInfo };
+	// shader permutation is picked by specialization constants, driver drops unused branches
+	struct {
+		uint32_t colorMode;
+		float alpha;
+	} specializationData = { key.colorMode, key.blend == PipelineKey::BLEND_OPAQUE ? 1.0f : 0.5f };
+
+	VkSpecializationMapEntry specializationEntries[] = {
+		{ 0, offsetof(decltype(specializationData), colorMode), sizeof(uint32_t) },
+		{ 1, offsetof(decltype(specializationData), alpha), sizeof(float) }
+	};
 
-	// add vertices in shader
-	VkVertexInputBindingDescription vertexBindingDescription = { };
-	vertexBindingDescription.binding = 0;
-	vertexBindingDescription.stride = sizeof(Vertex);
-	vertexBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	VkSpecializationInfo specializationInfo = { };
+	specializationInfo.mapEntryCount = 2;
+	specializationInfo.pMapEntries = specializationEntries;
+	specializationInfo.dataSize = sizeof(specializationData);
+	specializationInfo.pData = &specializationData;
+	fragmentShaderStageCreateInfo.pSpecializationInfo = &specializationInfo;
+
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageCreateInfo, fragmentShaderStageCreateInfo };
 
-	VkVertexInputAttributeDescription posAttributeDescription = { };
-	posAttributeDescription.binding = 0;
-	posAttributeDescription.location = 0;
-	posAttributeDescription.format = VK_FORMAT_R32G32_SFLOAT;
-	posAttributeDescription.offset = offsetof(Vertex, pos);
+	// add vertices in shader, binding 1 advances once per instance
+	VkVertexInputBindingDescription bindings[] = {
+		options_.compactVertices ? vertexBinding<CompactVertex>(0, VK_VERTEX_INPUT_RATE_VERTEX)
+			: vertexBinding<Vertex>(0, VK_VERTEX_INPUT_RATE_VERTEX),
+		vertexBinding<InstanceData>(1, VK_VERTEX_INPUT_RATE_INSTANCE)
+	};
 
-	VkVertexInputAttributeDescription colorAttributeDescription = { };
-	colorAttributeDescription.binding = 0;
-	colorAttributeDescription.location = 1;
-	colorAttributeDescription.format = VK_FORMAT_R32G32B32_SFLOAT;
-	colorAttributeDescription.offset = offsetof(Vertex, color);
+	auto vertexAttributes = options_.compactVertices ? VertexLayout<CompactVertex>::attributes(0, 0)
+		: VertexLayout<Vertex>::attributes(0, 0);
+	auto instanceAttributes = VertexLayout<InstanceData>::attributes(1, (uint32_t)vertexAttributes.size());
 
-	VkVertexInputAttributeDescription attributes[] = { posAttributeDescription, colorAttributeDescription };
+	std::vector<VkVertexInputAttributeDescription> attributes(vertexAttributes.begin(), vertexAttributes.end());
+	attributes.insert(attributes.end(), instanceAttributes.begin(), instanceAttributes.end());
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = { };
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &vertexBindingDescription;
-	vertexInputInfo.vertexAttributeDescriptionCount = 2;
-	vertexInputInfo.pVertexAttributeDescriptions = attributes;
+	vertexInputInfo.vertexBindingDescriptionCount = 2;
+	vertexInputInfo.pVertexBindingDescriptions = bindings;
+	vertexInputInfo.vertexAttributeDescriptionCount = (uint32_t)attributes.size();
+	vertexInputInfo.pVertexAttributeDescriptions = attributes.data();
 
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = { };
 	inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssemblyInfo.topology = key.topology;
 	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport = { };
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)info_.WIDTH;
-	viewport.height = (float)info_.HEIGHT;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = { };
-	scissor.offset = { 0, 0 };
-	scissor.extent = { (uint32_t)info_.WIDTH, (uint32_t)info_.HEIGHT };
-
+	// viewport and scissor are set while recording, so resize doesn't touch pipeline
 	VkPipelineViewportStateCreateInfo viewportInfo = { };
 	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportInfo.viewportCount = 1;
-	viewportInfo.pViewports = &viewport;
+	viewportInfo.pViewports = nullptr;
 	viewportInfo.scissorCount = 1;
-	viewportInfo.pScissors = &scissor;
+	viewportInfo.pScissors = nullptr;
+
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicStateInfo = { };
+	dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateInfo.dynamicStateCount = 2;
+	dynamicStateInfo.pDynamicStates = dynamicStates;
 
 	VkPipelineRasterizationStateCreateInfo rasterizationCreateInfo = { };
 	rasterizationCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 	rasterizationCreateInfo.depthClampEnable = VK_FALSE;
 	rasterizationCreateInfo.rasterizerDiscardEnable = VK_FALSE;
-	rasterizationCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizationCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterizationCreateInfo.polygonMode = key.polygonMode;
+	rasterizationCreateInfo.cullMode = key.cullMode;
 	rasterizationCreateInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
 	rasterizationCreateInfo.depthBiasEnable = VK_FALSE;
 	rasterizationCreateInfo.depthBiasConstantFactor = 0.0f;
@@ -395,6 +735,16 @@ void VulkanApp::createGraphicsPipeline()
 	multisampleInfo.alphaToCoverageEnable = VK_FALSE;
 	multisampleInfo.alphaToOneEnable = VK_FALSE;
 	
+	// opaque variants write depth, blended ones are only tested against it; equal depth passes,
+	// so geometry at same depth still covers in draw order
+	VkPipelineDepthStencilStateCreateInfo depthStencilInfo = { };
+	depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencilInfo.depthTestEnable = VK_TRUE;
+	depthStencilInfo.depthWriteEnable = key.blend == PipelineKey::BLEND_OPAQUE ? VK_TRUE : VK_FALSE;
+	depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
+	depthStencilInfo.stencilTestEnable = VK_FALSE;
+
 	VkPipelineColorBlendAttachmentState colorBlendAttachment = { };
 	colorBlendAttachment.blendEnable = VK_FALSE;
 	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
@@ -406,6 +756,12 @@ void VulkanApp::createGraphicsPipeline()
 	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
 		VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 
+	if (key.blend != PipelineKey::BLEND_OPAQUE) {
+		colorBlendAttachment.blendEnable = VK_TRUE;
+		colorBlendAttachment.srcColorBlendFactor = key.blend == PipelineKey::BLEND_ALPHA ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.dstColorBlendFactor = key.blend == PipelineKey::BLEND_ALPHA ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+	}
+
 	VkPipelineColorBlendStateCreateInfo colorBlendInfo = { };
 	colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 	colorBlendInfo.logicOpEnable = VK_FALSE;
@@ -416,15 +772,83 @@ void VulkanApp::createGraphicsPipeline()
 	colorBlendInfo.blendConstants[2] = 0.0f;
 	colorBlendInfo.blendConstants[3] = 0.0f;
 
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 0;
-	pipelineLayoutInfo.pSetLayouts = nullptr;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;	
+	VkGraphicsPipelineCreateInfo createInfo = { };
+	createInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	createInfo.stageCount = 2;
+	createInfo.pStages = shaderStages;
+	createInfo.pVertexInputState = &vertexInputInfo;
+	createInfo.pInputAssemblyState = &inputAssemblyInfo;
+	createInfo.pViewportState = &viewportInfo;
+	createInfo.pRasterizationState = &rasterizationCreateInfo;
+	createInfo.pMultisampleState = &multisampleInfo;
+	createInfo.pDepthStencilState = &depthStencilInfo;
+	createInfo.pColorBlendState = &colorBlendInfo;
+	createInfo.pDynamicState = &dynamicStateInfo;
+	createInfo.layout = pipelineLayout_;
+	createInfo.renderPass = renderGraph_.renderPass(scenePass_);
+	createInfo.subpass = renderGraph_.subpass(scenePass_);
+	createInfo.flags = flags;
+	createInfo.basePipelineHandle = basePipeline;
+	createInfo.basePipelineIndex = -1;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	if (vkCreateGraphicsPipelines(device_, pipelineCache_.handle(), 1, &createInfo, nullptr, &pipeline) != VK_SUCCESS)
+		throw std::runtime_error("failed to create graphic pipeline!");
 
-	if (vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
-		throw std::runtime_error("failed to create pipeline layout!");
+	return pipeline;
+}
+
+// fullscreen triangle in post subpass, no vertex input and no variants
+void VulkanApp::createPostPipeline()
+{
+	VkPipelineShaderStageCreateInfo shaderStages[2] = { };
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = shaderLibrary_.load(info_.postVertexFile);
+	shaderStages[0].pName = "main";
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = shaderLibrary_.load(info_.postFragmentFile);
+	shaderStages[1].pName = "main";
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = { };
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = { };
+	inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewportInfo = { };
+	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportInfo.viewportCount = 1;
+	viewportInfo.scissorCount = 1;
+
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicStateInfo = { };
+	dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateInfo.dynamicStateCount = 2;
+	dynamicStateInfo.pDynamicStates = dynamicStates;
+
+	VkPipelineRasterizationStateCreateInfo rasterizationCreateInfo = { };
+	rasterizationCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizationCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizationCreateInfo.cullMode = VK_CULL_MODE_NONE;
+	rasterizationCreateInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	rasterizationCreateInfo.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisampleInfo = { };
+	multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = { };
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+		VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo colorBlendInfo = { };
+	colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlendInfo.attachmentCount = 1;
+	colorBlendInfo.pAttachments = &colorBlendAttachment;
 
 	VkGraphicsPipelineCreateInfo createInfo = { };
 	createInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -436,160 +860,670 @@ void VulkanApp::createGraphicsPipeline()
 	createInfo.pRasterizationState = &rasterizationCreateInfo;
 	createInfo.pMultisampleState = &multisampleInfo;
 	createInfo.pColorBlendState = &colorBlendInfo;
-	createInfo.layout = pipelineLayout_;
-	createInfo.renderPass = renderPass_;
-	createInfo.subpass = 0;
-	createInfo.basePipelineHandle = VK_NULL_HANDLE;
+	createInfo.pDynamicState = &dynamicStateInfo;
+	createInfo.layout = postPipelineLayout_;
+	createInfo.renderPass = renderGraph_.renderPass(postPass_);
+	createInfo.subpass = renderGraph_.subpass(postPass_);
+	createInfo.basePipelineIndex = -1;
+
+	// previous one exists only when render graph was rebuilt
+	if (postPipeline_) {
+		VkPipeline oldPipeline = postPipeline_;
+		deferDestroy([this, oldPipeline] { vkDestroyPipeline(device_, oldPipeline, nullptr); });
+		postPipeline_ = VK_NULL_HANDLE;
+	}
 
-	if (vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &createInfo, nullptr, &graphicPipeline_) != VK_SUCCESS)
+	if (vkCreateGraphicsPipelines(device_, pipelineCache_.handle(), 1, &createInfo, nullptr, &postPipeline_) != VK_SUCCESS)
 		throw std::runtime_error("failed to create graphic pipeline!");
+}
+
+// glslangValidator of Vulkan SDK, same compiler project build step runs; started directly,
+// so no shell parses file names
+static void compileShader(const std::string& source, const std::string& output)
+{
+	const char* sdk = std::getenv("VULKAN_SDK");
+#ifdef _WIN32
+	std::string compiler = sdk ? std::string(sdk) + "\\Bin\\glslangValidator.exe" : "glslangValidator.exe";
+
+	// spawned process gets arguments joined by spaces, quotes keep paths in one piece
+	std::string quotedSource = "\"" + source + "\"";
+	std::string quotedOutput = "\"" + output + "\"";
+	const char* argv[] = { "glslangValidator", "-V", quotedSource.c_str(), "-o", quotedOutput.c_str(), nullptr };
+
+	int status = (int)_spawnvp(_P_WAIT, compiler.c_str(), argv);
+#else
+	std::string compiler = sdk ? std::string(sdk) + "/bin/glslangValidator" : "glslangValidator";
+	const char* argv[] = { "glslangValidator", "-V", source.c_str(), "-o", output.c_str(), nullptr };
+
+	int status = -1;
+	pid_t pid = 0;
+	if (posix_spawnp(&pid, compiler.c_str(), nullptr, nullptr, const_cast<char* const*>(argv), environ) == 0) {
+		if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+			status = -1;
+		else
+			status = WEXITSTATUS(status);
+	}
+#endif
 
-	// destroy shader modules
-	vkDestroyShaderModule(device_, fragmentShaderModule, nullptr);
-	vkDestroyShaderModule(device_, vertexShaderModule, nullptr);
+	if (status != 0)
+		throw std::runtime_error("failed to compile " + source);
 }
 
-void VulkanApp::createCommandPool()
+static std::string fileName(const std::string& path)
 {
-	auto indices = getFamilyIndices(physicalDevice_);
+	return path.substr(path.find_last_of("/\\") + 1);
+}
 
-	VkCommandPoolCreateInfo createInfo = { };
-	createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	createInfo.queueFamilyIndex = indices.graphicFamily;
+void VulkanApp::createShaderWatcher()
+{
+	if (!options_.watchShaders)
+		return;
 
-	if (vkCreateCommandPool(device_, &createInfo, nullptr, &commandPool_) != VK_SUCCESS)
-		throw std::runtime_error("failed to create command pool");
+	shaderWatcher_.init(info_.shaderDirectory);
+	pipelineCompiler_.init(device_);
+}
+
+void VulkanApp::updateShaders()
+{
+	if (!shaderWatcher_.isWatching())
+		return;
+
+	// pipelines finished since last frame go in now, old ones may still be used by frames in flight
+	PipelineCompiler::Result result;
+	while (pipelineCompiler_.poll(result)) {
+		if (!result.error.empty()) {
+			std::cerr << "Shader reload failed: " << result.error << std::endl;
+			continue;
+		}
+
+		for (auto pipeline : pipelineVariants_.replace(result.pipelines))
+			deferDestroy([this, pipeline] { vkDestroyPipeline(device_, pipeline, nullptr); });
+
+		std::cout << "Shaders reloaded, " << result.pipelines.size() << " pipelines built in " << result.time << " ms" << std::endl;
+	}
+
+	std::vector<std::string> sources;
+	bool changed = false;
+
+	for (const auto& name : shaderWatcher_.poll()) {
+		if (name == fileName(info_.vertexSource) || name == fileName(info_.fragmentSource)) {
+			sources.push_back(name);
+			changed = true;
+		}
+		else if (name == fileName(info_.vertexFile) || name == fileName(info_.fragmentFile)) {
+			changed = true;
+		}
+	}
+
+	if (!changed)
+		return;
+
+	// everything below runs on compiler thread, render thread keeps drawing with current pipeline;
+	// writing spv triggers one more request, it finds code unchanged and builds nothing
+	pipelineCompiler_.submit([this, sources]() -> std::vector<VkPipeline> {
+		for (const auto& name : sources) {
+			if (name == fileName(info_.vertexSource))
+				compileShader(info_.vertexSource, info_.vertexFile);
+			else
+				compileShader(info_.fragmentSource, info_.fragmentFile);
+		}
+
+		VkShaderModule vertexShaderModule = VK_NULL_HANDLE;
+		VkShaderModule fragmentShaderModule = VK_NULL_HANDLE;
+		bool vertexChanged = shaderLibrary_.reload(info_.vertexFile, vertexShaderModule);
+		bool fragmentChanged = shaderLibrary_.reload(info_.fragmentFile, fragmentShaderModule);
+
+		if (!vertexChanged && !fragmentChanged)
+			return { };
+
+		// thread pool records frames meanwhile, variants are built one by one here
+		return pipelineVariants_.build(device_, nullptr,
+			[&](const PipelineKey& key, VkPipelineCreateFlags flags, VkPipeline basePipeline) {
+				return buildGraphicsPipeline(vertexShaderModule, fragmentShaderModule, key, flags, basePipeline);
+			});
+	});
+}
+
+void VulkanApp::createProfiler()
+{
+	profiler_.init(physicalDevice_, device_, familyIndices_.graphicFamily,
+		options_.framesInFlight, enabledFeatures_.pipelineStatisticsQuery == VK_TRUE);
+}
+
+void VulkanApp::createThreadPool()
+{
+	// compiles pipeline variants at startup, records draws afterwards
+	threadPool_.init(options_.recordThreads);
+}
+
+void VulkanApp::createRecorder()
+{
+	recorder_.init(device_, familyIndices_.graphicFamily, options_.framesInFlight, &threadPool_);
 }
 
 void VulkanApp::createFramebuffers()
 {
-	framebuffers_.resize(imageViews_.size(), VK_NULL_HANDLE);
+	renderGraph_.createTargets(&allocator_, { (uint32_t)info_.WIDTH, (uint32_t)info_.HEIGHT }, { imageViews_ });
 
-	for (size_t i = 0; i < framebuffers_.size(); ++i) {
-		VkImageView attachments[] = { imageViews_[i] };
+	if (options_.postProcess)
+		createPostDescriptorSet();
+}
 
-		VkFramebufferCreateInfo createInfo = { };
-		createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		createInfo.renderPass = renderPass_;
-		createInfo.attachmentCount = 1;
-		createInfo.pAttachments = attachments;
-		createInfo.width = info_.WIDTH;
-		createInfo.height = info_.HEIGHT;
-		createInfo.layers = 1;
+// scene color view changes with every createTargets(), set of previous one may still be in use
+void VulkanApp::createPostDescriptorSet()
+{
+	if (postDescriptorPool_) {
+		VkDescriptorPool oldPool = postDescriptorPool_;
+		deferDestroy([this, oldPool] { vkDestroyDescriptorPool(device_, oldPool, nullptr); });
+		postDescriptorPool_ = VK_NULL_HANDLE;
+	}
 
-		if (vkCreateFramebuffer(device_, &createInfo, nullptr, &framebuffers_[i]) != VK_SUCCESS)
-			throw std::runtime_error("failed to create framebuffer!");
+	VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1 };
+
+	VkDescriptorPoolCreateInfo poolInfo = { };
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (vkCreateDescriptorPool(device_, &poolInfo, nullptr, &postDescriptorPool_) != VK_SUCCESS)
+		throw std::runtime_error("failed to create descriptor pool");
+
+	VkDescriptorSetAllocateInfo allocInfo = { };
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = postDescriptorPool_;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &postSetLayout_;
+
+	if (vkAllocateDescriptorSets(device_, &allocInfo, &postDescriptorSet_) != VK_SUCCESS)
+		throw std::runtime_error("failed to allocate descriptor set");
+
+	VkDescriptorImageInfo imageInfo = { };
+	imageInfo.imageView = renderGraph_.imageView(sceneColor_);
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write = { };
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = postDescriptorSet_;
+	write.dstBinding = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	write.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+}
+
+void VulkanApp::createFrames()
+{
+	frames_.resize(options_.framesInFlight);
+
+	for (auto& frame : frames_) {
+		VkCommandPoolCreateInfo poolInfo = { };
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = familyIndices_.graphicFamily;
+
+		if (vkCreateCommandPool(device_, &poolInfo, nullptr, &frame.commandPool) != VK_SUCCESS)
+			throw std::runtime_error("failed to create frame command pool");
+
+		VkCommandBufferAllocateInfo allocInfo = { };
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = frame.commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(device_, &allocInfo, &frame.commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("failed to allocate frame command buffer!");
+
+		VkSemaphoreCreateInfo semaphoreInfo = { };
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &frame.imageAvailableSemaphore) != VK_SUCCESS ||
+			vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &frame.renderFinishedSemaphore) != VK_SUCCESS)
+			throw std::runtime_error("failed to create semaphore");
+
+		// created signaled, so first wait on it doesn't block
+		VkFenceCreateInfo fenceInfo = { };
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+		if (vkCreateFence(device_, &fenceInfo, nullptr, &frame.inFlightFence) != VK_SUCCESS)
+			throw std::runtime_error("failed to create fence");
 	}
+
+	imagesInFlight_.assign(imageViews_.size(), VK_NULL_HANDLE);
+	currentFrame_ = 0;
+
+	// batch runs want every frame as soon as possible, others start cpu work as late as it can be
+	pacer_.init(options_.presentProfile != PRESENT_THROUGHPUT);
 }
 
-void VulkanApp::createCommandBuffers()
+// draw lists shorter than this aren't worth waking worker threads
+static const uint32_t MIN_DRAWS_PER_SLICE = 256;
+
+// each draw sits on its own layer in view space, scattered so that submission order says
+// nothing about depth; same draw keeps its layer every frame
+static float drawDepth(uint32_t draw)
 {
-	VkCommandBufferAllocateInfo allocInfo = { };
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = commandPool_;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = (uint32_t) framebuffers_.size();
+	uint32_t hash = draw * 2654435761u;
+	return ((hash >> 8) + 0.5f) / (1u << 24);
+}
+
+void VulkanApp::buildDrawList()
+{
+	drawList_.clear();
+
+	// gpu writes draws of culled objects itself
+	if (culling_.objectCount())
+		return;
+
+	if (options_.streamTriangles) {
+		for (uint32_t i = 0; i < options_.streamTriangles; ++i) {
+			DrawItem item;
+			item.vertexCount = 3;
+			item.firstVertex = i * 3;
+			item.instanceCount = particles_.count() ? particles_.count() : std::max(options_.instanceCount, 1u);
+			item.depth = drawDepth(i);
+			drawList_.push_back(item);
+		}
+	}
+	else {
+		DrawItem item;
+		item.vertexCount = meshVertexCount_;
+		item.instanceCount = particles_.count() ? particles_.count() : std::max(options_.instanceCount, 1u);
+		item.indexCount = indexBuffer_ ? meshIndexCount_ : 0;
+		drawList_.assign(std::max(options_.drawCount, 1u), item);
+		for (uint32_t i = 0; i < (uint32_t)drawList_.size(); ++i)
+			drawList_[i].depth = drawDepth(i);
+	}
+
+	// opaque draws go front to back, so early depth test rejects hidden fragments before they
+	// are shaded; blended ones keep back to front order
+	bool frontToBack = pipelineVariants_.keys()[activeVariant_].blend == PipelineKey::BLEND_OPAQUE;
+	std::sort(drawList_.begin(), drawList_.end(), [frontToBack](const DrawItem& a, const DrawItem& b) {
+		return frontToBack ? a.depth < b.depth : a.depth > b.depth;
+	});
+}
 
-	commandBuffers_.resize(framebuffers_.size(), VK_NULL_HANDLE);
-	if (vkAllocateCommandBuffers(device_, &allocInfo, commandBuffers_.data()) != VK_SUCCESS)
-		throw std::runtime_error("failed to allocate command buffers!");
+void VulkanApp::recordCommandBuffer(FrameData& frame, uint32_t imageIndex)
+{
+	VkCommandBuffer commandBuffer = frame.commandBuffer;
+
+	VkCommandBufferBeginInfo beginInfo = { };
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	profiler_.beginFrame(commandBuffer, (uint32_t)currentFrame_);
+	uint32_t frameScope = profiler_.beginScope(commandBuffer, "frame");
+
+	// take ownership of buffers uploaded on transfer queue
+	uploadEngine_.acquire(commandBuffer, frameNumber_, frame.waitSemaphores, frame.waitStages);
+
+	if (options_.streamTriangles && !vertexStream_.isDirect()) {
+		uint32_t copyScope = profiler_.beginScope(commandBuffer, "stream copy");
+		vertexStream_.record(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+		profiler_.endScope(commandBuffer, copyScope);
+	}
+
+	if (options_.instanceCount && !instanceStream_.isDirect()) {
+		uint32_t copyScope = profiler_.beginScope(commandBuffer, "instance copy");
+		instanceStream_.record(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+		profiler_.endScope(commandBuffer, copyScope);
+	}
+
+	if (culling_.objectCount()) {
+		uint32_t cullScope = profiler_.beginScope(commandBuffer, "cull");
+		culling_.record(commandBuffer, (uint32_t)currentFrame_);
+		profiler_.endScope(commandBuffer, cullScope);
+	}
+
+	parallelDraws_ = drawList_.size() >= MIN_DRAWS_PER_SLICE * 2 && threadPool_.threadCount() > 1;
+
+	// query can stay active over secondary buffers only with inheritedQueries
+	uint32_t renderPassScope = profiler_.beginScope(commandBuffer, "render pass",
+		!parallelDraws_ || enabledFeatures_.inheritedQueries);
+
+	renderGraph_.setContents(scenePass_,
+		parallelDraws_ ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+	renderGraph_.execute(commandBuffer, imageIndex);
+
+	profiler_.endScope(commandBuffer, renderPassScope);
+	profiler_.endScope(commandBuffer, frameScope);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("failed to record commands in command buffer!");
+}
+
+void VulkanApp::recordScene(const RenderGraph::PassContext& context)
+{
+	VkCommandBuffer commandBuffer = context.commandBuffer;
+
+	if (parallelDraws_) {
+		VkCommandBufferInheritanceInfo inheritanceInfo = { };
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = context.renderPass;
+		inheritanceInfo.subpass = context.subpass;
+		inheritanceInfo.framebuffer = context.framebuffer;
+		inheritanceInfo.pipelineStatistics = enabledFeatures_.inheritedQueries ? profiler_.statisticsFlags() : 0;
+
+		secondaryBuffers_.clear();
+		recorder_.record(inheritanceInfo, (uint32_t)drawList_.size(), MIN_DRAWS_PER_SLICE,
+			[this](VkCommandBuffer secondary, uint32_t first, uint32_t count) { recordDraws(secondary, first, count); },
+			secondaryBuffers_);
+
+		vkCmdExecuteCommands(commandBuffer, (uint32_t)secondaryBuffers_.size(), secondaryBuffers_.data());
+	}
+	else {
+		// timestamps can't be written in subpass with secondary contents, so only inline draws get own scope
+		uint32_t drawScope = profiler_.beginScope(commandBuffer, "draws");
+		recordDraws(commandBuffer, 0, (uint32_t)drawList_.size());
+		profiler_.endScope(commandBuffer, drawScope);
+	}
+}
+
+void VulkanApp::recordPost(const RenderGraph::PassContext& context)
+{
+	VkCommandBuffer commandBuffer = context.commandBuffer;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, postPipeline_);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, postPipelineLayout_, 0, 1, &postDescriptorSet_, 0, nullptr);
+
+	VkViewport viewport = { 0.0f, 0.0f, (float)info_.WIDTH, (float)info_.HEIGHT, 0.0f, 1.0f };
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = { { 0, 0 }, { (uint32_t)info_.WIDTH, (uint32_t)info_.HEIGHT } };
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+void VulkanApp::recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount)
+{
+	// secondary buffers inherit no state, so every slice binds everything it uses
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineVariants_.get(activeVariant_));
+
+	VkViewport viewport = { };
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)info_.WIDTH;
+	viewport.height = (float)info_.HEIGHT;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = { };
+	scissor.offset = { 0, 0 };
+	scissor.extent = { (uint32_t)info_.WIDTH, (uint32_t)info_.HEIGHT };
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	// offset is into per-frame region of instance stream, other buffers start at 0
+	VkBuffer instanceBuffer = identityInstanceBuffer_;
+	VkDeviceSize instanceOffset = 0;
+	if (culling_.objectCount())
+		instanceBuffer = culling_.objectBuffer();
+	else if (particles_.count())
+		instanceBuffer = particles_.instanceBuffer((uint32_t)currentFrame_);
+	else if (options_.instanceCount) {
+		instanceBuffer = instanceStream_.buffer();
+		instanceOffset = instanceStreamOffset_;
+	}
+
+	VkBuffer vertexBuffers[] = {
+		options_.streamTriangles ? vertexStream_.buffer() : vertexBuffer_,
+		instanceBuffer
+	};
+	VkDeviceSize offsets[] = {
+		options_.streamTriangles ? vertexStreamOffset_ : 0,
+		instanceOffset
+	};
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+
+	if (indexBuffer_)
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer_, 0, indexType_);
+
+	float depth = -1.0f;
+	for (uint32_t i = firstDraw; i < firstDraw + drawCount; ++i) {
+		const auto& item = drawList_[i];
+
+		if (item.depth != depth) {
+			depth = item.depth;
+			vkCmdPushConstants(commandBuffer, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(float), &depth);
+		}
+
+		if (item.indexCount)
+			vkCmdDrawIndexed(commandBuffer, item.indexCount, item.instanceCount, item.firstIndex, (int32_t)item.firstVertex, 0);
+		else
+			vkCmdDraw(commandBuffer, item.vertexCount, item.instanceCount, item.firstVertex, 0);
+	}
+
+	// draw list is empty then, so this runs once, inline
+	if (culling_.objectCount()) {
+		depth = 0.0f;
+		vkCmdPushConstants(commandBuffer, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(float), &depth);
+		culling_.draw(commandBuffer, (uint32_t)currentFrame_);
+	}
+}
+
+void VulkanApp::drawFrame()
+{
+	telemetry_.beginFrame();
+	if (frameNumber_ == options_.warmupFrames) {
+		telemetry_.resetTotals();
+		totalLatencyHistogram_.reset();
+		streamTotals_ = { };
+	}
+
+	auto& frame = frames_[currentFrame_];
+
+	// wait until gpu is done with resources of this frame slot
+	auto blockStart = FramePacer::Clock::now();
+	vkWaitForFences(device_, 1, &frame.inFlightFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	pacer_.addBlocked(blockStart);
+	telemetry_.mark(FrameTelemetry::PHASE_WAIT);
+
+	// time frame would spend blocked later is slept here, so input below is as fresh as it can be
+	pacer_.pace();
+	telemetry_.mark(FrameTelemetry::PHASE_PACING);
+
+	if (!options_.headless)
+		glfwPollEvents();
+	auto inputTime = FramePacer::Clock::now();
+
+	deletionQueue_.collect(frameNumber_);
+
+	// resize events since last frame end up in one recreation
+	if (resizePending_)
+		recreateSwapchain();
+
+	// frames before the one that used this slot last are complete too
+	uint64_t completedFrameCount = frameNumber_ + 1 >= frames_.size() ? frameNumber_ + 1 - frames_.size() : 0;
+	uploadEngine_.collect(completedFrameCount);
+	uploadEngine_.flush();
+
+	// region of this slot was read by the frame just waited on
+	updateVertexStream();
+	updateInstances();
+	if (options_.streamTriangles || options_.instanceCount) {
+		++streamStats_.frames;
+		++streamTotals_.frames;
+	}
+	updateShaders();
+
+	// submitted before recording, on async queue it runs while previous frame rasterizes
+	VkSemaphore particlesReady = particles_.count() ? particles_.simulate((uint32_t)currentFrame_) : VK_NULL_HANDLE;
+
+	recorder_.beginFrame((uint32_t)currentFrame_);
+	buildDrawList();
+	telemetry_.mark(FrameTelemetry::PHASE_UPDATE);
+
+	// window may change between resize check and acquire, then swapchain is rebuilt right away;
+	// semaphore isn't signaled by failed acquire, so it can be used again
+	const uint32_t maxAttempts = 3;
+	uint32_t imageIndex = 0;
+	blockStart = FramePacer::Clock::now();
+	for (uint32_t attempt = 1; !acquireNextImage(frame.imageAvailableSemaphore, imageIndex); ++attempt) {
+		if (attempt == maxAttempts)
+			throw std::runtime_error("failed to acquire swapchain image");
+		recreateSwapchain();
+	}
+
+	// image may still be used by another frame slot if acquire returns images out of order
+	if (imagesInFlight_[imageIndex] != VK_NULL_HANDLE && imagesInFlight_[imageIndex] != frame.inFlightFence)
+		vkWaitForFences(device_, 1, &imagesInFlight_[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	imagesInFlight_[imageIndex] = frame.inFlightFence;
+	pacer_.addBlocked(blockStart);
+	telemetry_.mark(FrameTelemetry::PHASE_ACQUIRE);
+
+	// offscreen targets are neither acquired nor presented, so there is nothing to wait or signal
+	frame.waitSemaphores.clear();
+	frame.waitStages.clear();
+	if (!options_.headless) {
+		frame.waitSemaphores.push_back(frame.imageAvailableSemaphore);
+		frame.waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	}
+	if (particlesReady) {
+		frame.waitSemaphores.push_back(particlesReady);
+		frame.waitStages.push_back(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	}
+
+	vkResetCommandPool(device_, frame.commandPool, 0);
+	recordCommandBuffer(frame, imageIndex);
+	telemetry_.mark(FrameTelemetry::PHASE_RECORD);
+
+	VkSubmitInfo submitInfo = { };
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = (uint32_t)frame.waitSemaphores.size();
+	submitInfo.pWaitSemaphores = frame.waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = frame.waitStages.data();
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &frame.commandBuffer;
 
-	for (size_t i = 0; i < commandBuffers_.size(); ++i) {
-		VkCommandBufferBeginInfo beginInfo = { };
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	VkSemaphore signalSemaphores[] = { frame.renderFinishedSemaphore };
 
-		vkBeginCommandBuffer(commandBuffers_[i], &beginInfo);
+	submitInfo.signalSemaphoreCount = options_.headless ? 0 : 1;
+	submitInfo.pSignalSemaphores = signalSemaphores;
 
-		VkRenderPassBeginInfo renderpassBeginInfo = { };
-		renderpassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderpassBeginInfo.renderPass = renderPass_;
-		renderpassBeginInfo.framebuffer = framebuffers_[i];
-		renderpassBeginInfo.renderArea.offset = { 0, 0 };
-		renderpassBeginInfo.renderArea.extent = { (uint32_t)info_.WIDTH, (uint32_t)info_.HEIGHT };
-		renderpassBeginInfo.clearValueCount = 1;
+	vkResetFences(device_, 1, &frame.inFlightFence);
 
-		VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-		renderpassBeginInfo.pClearValues = &clearColor;
-		
-		vkCmdBeginRenderPass(commandBuffers_[i], &renderpassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	if (vkQueueSubmit(graphicQueue_, 1, &submitInfo, frame.inFlightFence) != VK_SUCCESS)
+		throw std::runtime_error("failed to submit command buffer!");
+	telemetry_.mark(FrameTelemetry::PHASE_SUBMIT);
 
-		vkCmdBindPipeline(commandBuffers_[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicPipeline_);
+	blockStart = FramePacer::Clock::now();
+	presentImage(imageIndex, frame.renderFinishedSemaphore);
+	pacer_.addBlocked(blockStart);
+	telemetry_.mark(FrameTelemetry::PHASE_PRESENT);
 
-		VkBuffer vertexBuffers[] = { vertexBuffer_ };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffers_[i], 0, 1, vertexBuffers, offsets);
+	// what presentation engine shows on top of this isn't visible without display timing extension
+	double latency = std::chrono::duration<double, std::milli>(FramePacer::Clock::now() - inputTime).count();
+	latencyHistogram_.record(latency);
+	totalLatencyHistogram_.record(latency);
+	pacer_.endFrame();
 
-		vkCmdDraw(commandBuffers_[i], vertices.size(), 1, 0, 0);
+	currentFrame_ = (currentFrame_ + 1) % frames_.size();
+	++frameNumber_;
 
-		vkCmdEndRenderPass(commandBuffers_[i]);
+	if (frameNumber_ == 1)
+		finishStartup();
 
-		if (vkEndCommandBuffer(commandBuffers_[i]) != VK_SUCCESS)
-			throw std::runtime_error("failed to record commands in command buffer!");
-	}
+	if (telemetry_.endFrame())
+		publishTelemetry();
 }
 
-void VulkanApp::createSemaphores()
+// startup is over once first frame is submitted
+void VulkanApp::finishStartup()
 {
-	VkSemaphoreCreateInfo imageAvailableInfo = { };
-	imageAvailableInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	trace_.add("first frame", initEnd_, StartupTrace::Clock::now());
+	startupTime_ = trace_.elapsed();
 
-	VkSemaphoreCreateInfo renderFinishedInfo = { };
-	renderFinishedInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	if (options_.verbose) {
+		trace_.print(std::cout);
+		std::cout << "Time to first frame: " << startupTime_ << " ms" << std::endl;
 
-	if (vkCreateSemaphore(device_, &imageAvailableInfo, nullptr, &imageAvailableSemaphore_) != VK_SUCCESS ||
-		vkCreateSemaphore(device_, &renderFinishedInfo, nullptr, &renderFinishedSemaphore_) != VK_SUCCESS)
-		throw std::runtime_error("failed to create semaphore");
+		// after first frame, so listing device isn't counted as startup
+		showInfo();
+	}
+
+	// missing trace isn't worth stopping the run
+	try {
+		if (!options_.traceFile.empty())
+			trace_.save(options_.traceFile);
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+	}
 }
 
-void VulkanApp::drawFrame()
+bool VulkanApp::acquireNextImage(VkSemaphore imageAvailableSemaphore, uint32_t& imageIndex)
 {
-	static size_t frameCount = 0;
-	++frameCount;
-	if (timer_.tick()) {
-		std::cout << "\nFPS: " << frameCount << std::endl;
-		frameCount = 0;
+	if (options_.headless) {
+		imageIndex = nextOffscreenTarget_;
+		nextOffscreenTarget_ = (nextOffscreenTarget_ + 1) % offscreenTargets_.size();
+		return true;
 	}
 
-	uint32_t imageIndex = 0;
-	vkAcquireNextImageKHR(device_, swapchain_, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphore_, 0, &imageIndex);
-
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphore_ };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	VkResult result = vkAcquireNextImageKHR(device_, swapchain_, std::numeric_limits<uint64_t>::max(),
+		imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
 
-	VkSubmitInfo submitInfo = { };
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers_[imageIndex];
+	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		return false;
 
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphore_ };
+	// image is still usable, swapchain is replaced after this frame
+	if (result == VK_SUBOPTIMAL_KHR)
+		resizePending_ = true;
+	else if (result != VK_SUCCESS)
+		throw std::runtime_error("failed to acquire swapchain image");
 
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
+	return true;
+}
 
-	if (vkQueueSubmit(graphicQueue_, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
-		throw std::runtime_error("failed to submit command buffer!");
+void VulkanApp::presentImage(uint32_t imageIndex, VkSemaphore renderFinishedSemaphore)
+{
+	if (options_.headless)
+		return;
 
 	VkPresentInfoKHR presentInfo = { };
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	presentInfo.pWaitSemaphores = &renderFinishedSemaphore;
 
 	VkSwapchainKHR swapchains[] = { swapchain_ };
 	presentInfo.swapchainCount = 1;
 	presentInfo.pSwapchains = swapchains;
 	presentInfo.pImageIndices = &imageIndex;
 	
-	vkQueuePresentKHR(presentQueue_, &presentInfo);
+	// either way image was consumed, new swapchain is made at next frame boundary
+	VkResult result = vkQueuePresentKHR(presentQueue_, &presentInfo);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		resizePending_ = true;
+	else if (result != VK_SUCCESS)
+		throw std::runtime_error("failed to present swapchain image");
 }
 
 void VulkanApp::mainLoop()
 {
-	while (!glfwWindowShouldClose(window_)) {
-		glfwPollEvents();
+	if (options_.headless) {
+		for (uint32_t i = 0; options_.frameCount == 0 || i < options_.frameCount; ++i)
+			drawFrame();
+
+		return;
+	}
+
+	for (uint32_t i = 0; !glfwWindowShouldClose(window_); ++i) {
+		if (options_.frameCount && i >= options_.frameCount)
+			break;
+
+		// minimized window has zero sized surface, nothing to render to until it comes back;
+		// otherwise events are polled by drawFrame, after frame pacing
+		int width = 0, height = 0;
+		glfwGetFramebufferSize(window_, &width, &height);
+		while ((width == 0 || height == 0) && !glfwWindowShouldClose(window_)) {
+			glfwWaitEvents();
+			glfwGetFramebufferSize(window_, &width, &height);
+		}
+
 		drawFrame();
 	}		
 	
@@ -608,21 +1542,37 @@ VulkanApp::FamilyIndices VulkanApp::getFamilyIndices(VkPhysicalDevice device)
 	FamilyIndices familyIndices = { };
 	for (uint32_t index = 0; index < familyProperties.size(); ++index) {
 		if (familyProperties[index].queueCount > 0) {
-			if (familyProperties[index].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			auto queueFlags = familyProperties[index].queueFlags;
+
+			if (queueFlags & VK_QUEUE_GRAPHICS_BIT && familyIndices.graphicFamily < 0)
 				familyIndices.graphicFamily = index;
 
+			// dedicated dma family copies in parallel with graphics work
+			if (queueFlags & VK_QUEUE_TRANSFER_BIT && !(queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+				familyIndices.transferFamily < 0)
+				familyIndices.transferFamily = index;
+
+			// compute family without graphics runs dispatches alongside rasterization
+			if (queueFlags & VK_QUEUE_COMPUTE_BIT && !(queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+				familyIndices.computeFamily < 0)
+				familyIndices.computeFamily = index;
+
+			if (familyIndices.presentFamily >= 0)
+				continue;
+
+			// in headless mode graphics queue takes present queue place
 			VkBool32 supported = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, index, surface_, &supported);
+			if (options_.headless)
+				supported = familyIndices.graphicFamily == (int32_t)index;
+			else
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, index, surface_, &supported);
 			if (supported)
 				familyIndices.presentFamily = index;
-
-			if (familyIndices.graphicFamily >= 0 && familyIndices.presentFamily >= 0)
-				return familyIndices;
 		}
 	}
 
-	// generate an exception if graphics and present families not supported
-	throw std::runtime_error("failed to find suitable queue families");
+	// -1 in graphic or present family - device doesn't fit, caller moves on to next one
+	return familyIndices;
 }
 
 void VulkanApp::checkInstanceLayersSupport()
@@ -688,58 +1638,40 @@ bool VulkanApp::checkDeviceExtensionSupport(VkPhysicalDevice device)
 	return true;
 }
 
+bool VulkanApp::hasDeviceExtension(VkPhysicalDevice device, const char* name)
+{
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+	for (const auto& extension : extensions) {
+		if (strcmp(extension.extensionName, name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
 void VulkanApp::setupDebugCallback()
 {
 	VkDebugReportCallbackCreateInfoEXT createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
-	createInfo.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
+	createInfo.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT |
+		VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT;
 	createInfo.pfnCallback = debugCallback;
+	createInfo.pUserData = this;
+
+	debugLog_.start(std::cerr);
 
 	if (CreateDebugReportCallbackEXT(instance_, &createInfo, nullptr, &callback_) != VK_SUCCESS) {
 		throw std::runtime_error("failed to set up debug callback!");
 	}
 }
 
-std::vector<char> VulkanApp::readFile(const std::string& filename)
-{
-	std::ifstream file(filename, std::ios::in | std::ios::ate | std::ios::binary);
-	if (!file.is_open())
-		throw std::runtime_error("failed to open file!");
-
-	size_t length = (size_t)file.tellg();					// or use function gcount?
-	std::vector<char> buffer(length);
-	file.seekg(0);
-
-	file.read(buffer.data(), length);
-	file.close();
-
-	return buffer;
-}
-
-void VulkanApp::createShaderModule(const std::vector<char>& code, VkShaderModule& mod)
-{
-	// TODO: ALIGNMENT!!!
-	VkShaderModuleCreateInfo createInfo = { };
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = (uint32_t*)code.data();
-
-	if (vkCreateShaderModule(device_, &createInfo, nullptr, &mod) != VK_SUCCESS)
-		throw std::runtime_error("failed to create shader module!");
-}
-
 uint32_t VulkanApp::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
 {
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &memProperties);
-
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i) {
-		if (typeFilter & (1 << i) &&
-			(memProperties.memoryTypes[i].propertyFlags & properties) == properties)		// check
-			return i;
-	}
-
-	throw std::runtime_error("failed to find suitable memory type!");
+	return allocator_.findMemoryType(typeFilter, properties);
 }
 
 VkSurfaceCapabilitiesKHR VulkanApp::getSurfaceCapabilities()
@@ -752,6 +1684,9 @@ VkSurfaceCapabilitiesKHR VulkanApp::getSurfaceCapabilities()
 
 VkSurfaceFormatKHR VulkanApp::getSurfaceFormat()
 {
+	if (options_.headless)
+		return { VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+
 	uint32_t formatCount = 0;
 	vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice_, surface_, &formatCount, nullptr);
 	std::vector<VkSurfaceFormatKHR> formats(formatCount);
@@ -768,94 +1703,81 @@ VkSurfaceFormatKHR VulkanApp::getSurfaceFormat()
 	return formats[0];	// for now
 }
 
-VkPresentModeKHR VulkanApp::getPresentMode()
+// every device supports one of these as optimal tiling depth attachment, D16 even is required
+VkFormat VulkanApp::getDepthFormat()
 {
-	uint32_t presentModeCount = 0;
-	vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice_, surface_, &presentModeCount, nullptr);
-	std::vector<VkPresentModeKHR> presentModes(presentModeCount);
-	vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice_, surface_, &presentModeCount, presentModes.data());
+	VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM };
+
+	for (auto format : candidates) {
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice_, format, &properties);
 
-	for (const auto& m : presentModes) {
-		if (m == VK_PRESENT_MODE_MAILBOX_KHR)
-			return m;	
+		if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+			return format;
 	}
 
-	return presentModes[0];	 
+	throw std::runtime_error("failed to find supported depth format");
 }
 
-// delete functions
-void VulkanApp::cleanup()
+VkPresentModeKHR VulkanApp::getPresentMode()
 {
-	vkDeviceWaitIdle(device_);
-
-	if (vertexBufferMemory_) {
-		vkFreeMemory(device_, vertexBufferMemory_, nullptr);
-		vertexBufferMemory_ = VK_NULL_HANDLE;
-	}
-
-	if (vertexBuffer_) {
-		vkDestroyBuffer(device_, vertexBuffer_, nullptr);
-		vertexBuffer_ = VK_NULL_HANDLE;
-	}
-
-	if (imageAvailableSemaphore_) {
-		vkDestroySemaphore(device_, imageAvailableSemaphore_, nullptr);
-		imageAvailableSemaphore_ = VK_NULL_HANDLE;
-	}
+	uint32_t presentModeCount = 0;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice_, surface_, &presentModeCount, nullptr);
+	std::vector<VkPresentModeKHR> presentModes(presentModeCount);
+	vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice_, surface_, &presentModeCount, presentModes.data());
 
-	if (renderFinishedSemaphore_) {
-		vkDestroySemaphore(device_, renderFinishedSemaphore_, nullptr);
-		renderFinishedSemaphore_ = VK_NULL_HANDLE;
+	// most wanted first, fifo is always supported
+	std::vector<VkPresentModeKHR> wanted;
+	switch (options_.presentProfile) {
+	case PRESENT_THROUGHPUT:
+		wanted = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+		break;
+	case PRESENT_LOW_LATENCY:
+		wanted = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		break;
+	case PRESENT_VSYNC:
+		break;
 	}
 
-	for (auto& framebuffer : framebuffers_) {
-		if (framebuffer) {
-			vkDestroyFramebuffer(device_, framebuffer, nullptr);
-			framebuffer = VK_NULL_HANDLE;
-		}
+	for (auto mode : wanted) {
+		if (std::find(presentModes.begin(), presentModes.end(), mode) != presentModes.end())
+			return mode;
 	}
 
-	if (graphicPipeline_) {
-		vkDestroyPipeline(device_, graphicPipeline_, nullptr);
-		graphicPipeline_ = VK_NULL_HANDLE;
-	}
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
 
-	if (pipelineLayout_) {
-		vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
-		pipelineLayout_ = VK_NULL_HANDLE;
-	}
+uint32_t VulkanApp::getImageCount(const VkSurfaceCapabilitiesKHR& capabilities, VkPresentModeKHR presentMode)
+{
+	// every queued fifo image is a frame of latency, mailbox needs a spare image to replace
+	uint32_t count = capabilities.minImageCount + 1;
+	if (options_.presentProfile == PRESENT_LOW_LATENCY && presentMode != VK_PRESENT_MODE_MAILBOX_KHR)
+		count = capabilities.minImageCount;
 
-	if (renderPass_) {
-		vkDestroyRenderPass(device_, renderPass_, nullptr);
-		renderPass_ = VK_NULL_HANDLE;
-	}
+	if (capabilities.maxImageCount)
+		count = std::min(count, capabilities.maxImageCount);
 
-	for (auto& imageView : imageViews_) {
-		if (imageView) {
-			vkDestroyImageView(device_, imageView, nullptr);
-			imageView = VK_NULL_HANDLE;
-		}	
-	}
+	return count;
+}
 
-	if (swapchain_) {
-		vkDestroySwapchainKHR(device_, swapchain_, nullptr);
-		swapchain_ = VK_NULL_HANDLE;
-	}
+// delete functions
+void VulkanApp::cleanup()
+{
+	telemetry_.stop();
 
-	if (commandPool_) {
-		vkDestroyCommandPool(device_, commandPool_, nullptr);
-		commandPool_ = VK_NULL_HANDLE;
-	}
+	// build in progress uses render pass and layout
+	pipelineCompiler_.destroy();
+	shaderWatcher_.destroy();
 
-	if (device_) {
-		vkDestroyDevice(device_, nullptr);
-		device_ = VK_NULL_HANDLE;
-	}
+	// startup may have failed before the device was created
+	if (device_)
+		destroyDevice();
 
 	if (callback_) {
 		DestroyDebugReportCallbackEXT(instance_, callback_, nullptr);
 		callback_ = VK_NULL_HANDLE;
 	}
+	debugLog_.stop();
 
 	if (surface_) {
 		vkDestroySurfaceKHR(instance_, surface_, nullptr);
@@ -868,47 +1790,71 @@ void VulkanApp::cleanup()
 	}
 }
 
-void VulkanApp::recreateSwapchain()
+void VulkanApp::destroyDevice()
 {
 	vkDeviceWaitIdle(device_);
 
-	int width = 0, height = 0;
-	glfwGetWindowSize(window_, &width, &height);
-	info_.WIDTH = width;
-	info_.HEIGHT = height;
+	deletionQueue_.flush();
+
+	uploadEngine_.destroy();
+
+	allocator_.destroyBuffer(vertexBuffer_, vertexBufferAllocation_);
+	allocator_.destroyBuffer(indexBuffer_, indexBufferAllocation_);
+	vertexStream_.destroy();
+	allocator_.destroyBuffer(identityInstanceBuffer_, identityInstanceAllocation_);
+	instanceStream_.destroy();
+	particles_.destroy();
+	culling_.destroy();
 
-	if (!commandBuffers_.empty()) {
-		vkFreeCommandBuffers(device_, commandPool_, commandBuffers_.size(), commandBuffers_.data());
-		commandBuffers_.clear();
+	for (auto& frame : frames_) {
+		if (frame.inFlightFence)
+			vkDestroyFence(device_, frame.inFlightFence, nullptr);
+
+		if (frame.imageAvailableSemaphore)
+			vkDestroySemaphore(device_, frame.imageAvailableSemaphore, nullptr);
+
+		if (frame.renderFinishedSemaphore)
+			vkDestroySemaphore(device_, frame.renderFinishedSemaphore, nullptr);
+
+		if (frame.commandPool)
+			vkDestroyCommandPool(device_, frame.commandPool, nullptr);
 	}
+	frames_.clear();
 
-	for (auto& framebuffer : framebuffers_) {
-		if (framebuffer) {
-			vkDestroyFramebuffer(device_, framebuffer, nullptr);
-			framebuffer = VK_NULL_HANDLE;
-		}
+	renderGraph_.destroy();
+
+	if (postPipeline_) {
+		vkDestroyPipeline(device_, postPipeline_, nullptr);
+		postPipeline_ = VK_NULL_HANDLE;
+	}
+
+	if (postDescriptorPool_) {
+		vkDestroyDescriptorPool(device_, postDescriptorPool_, nullptr);
+		postDescriptorPool_ = VK_NULL_HANDLE;
+	}
+
+	if (postPipelineLayout_) {
+		vkDestroyPipelineLayout(device_, postPipelineLayout_, nullptr);
+		postPipelineLayout_ = VK_NULL_HANDLE;
 	}
 
-	if (graphicPipeline_) {
-		vkDestroyPipeline(device_, graphicPipeline_, nullptr);
-		graphicPipeline_ = VK_NULL_HANDLE;
+	if (postSetLayout_) {
+		vkDestroyDescriptorSetLayout(device_, postSetLayout_, nullptr);
+		postSetLayout_ = VK_NULL_HANDLE;
 	}
 
+	pipelineVariants_.destroy(device_);
+
 	if (pipelineLayout_) {
 		vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
 		pipelineLayout_ = VK_NULL_HANDLE;
 	}
 
-	if (renderPass_) {
-		vkDestroyRenderPass(device_, renderPass_, nullptr);
-		renderPass_ = VK_NULL_HANDLE;
-	}
-
 	for (auto& imageView : imageViews_) {
 		if (imageView) {
 			vkDestroyImageView(device_, imageView, nullptr);
 			imageView = VK_NULL_HANDLE;
-		}
+		}	
 	}
 
 	if (swapchain_) {
@@ -916,23 +1862,90 @@ void VulkanApp::recreateSwapchain()
 		swapchain_ = VK_NULL_HANDLE;
 	}
 
+	for (auto& target : offscreenTargets_)
+		allocator_.destroyImage(target.image, target.allocation);
+	offscreenTargets_.clear();
+
+	recorder_.destroy();
+	threadPool_.destroy();
+	profiler_.destroy();
+
+	shaderLibrary_.destroy();
+
+	pipelineCache_.save();
+	pipelineCache_.destroy();
+
+	allocator_.destroy();
+
+	vkDestroyDevice(device_, nullptr);
+	device_ = VK_NULL_HANDLE;
+}
+
+void VulkanApp::recreateSwapchain()
+{
+	resizePending_ = false;
+	pacer_.reset();
+
+	// old swapchain is handed to the new one as oldSwapchain and destroyed later,
+	// frames in flight keep rendering to its images meanwhile
+	VkSwapchainKHR oldSwapchain = swapchain_;
+	std::vector<VkImageView> oldImageViews;
+	oldImageViews.swap(imageViews_);
+
 	createSwapchain();
-	createRenderPass();
-	createGraphicsPipeline();
+
+	// framebuffers and transient images are sized for old extent
+	auto destroyTargets = renderGraph_.releaseTargets();
+
+	deferDestroy([this, oldSwapchain, oldImageViews, destroyTargets] {
+		destroyTargets();
+
+		for (auto imageView : oldImageViews)
+			vkDestroyImageView(device_, imageView, nullptr);
+
+		if (oldSwapchain)
+			vkDestroySwapchainKHR(device_, oldSwapchain, nullptr);
+	});
+
+	// render passes only depend on format, pipeline has dynamic viewport and scissor,
+	// so they are rebuilt only in rare case when surface format changes
+	if (getSurfaceFormat().format != renderPassFormat_) {
+		// pipelines built in background are for old render pass, drop them
+		pipelineCompiler_.wait();
+		PipelineCompiler::Result stale;
+		while (pipelineCompiler_.poll(stale)) {
+			for (auto pipeline : stale.pipelines)
+				vkDestroyPipeline(device_, pipeline, nullptr);
+		}
+
+		deferDestroy(renderGraph_.release());
+
+		// old pipelines are retired by createGraphicsPipeline
+		createRenderGraph();
+		createGraphicsPipeline();
+	}
+
 	createFramebuffers();
-	createCommandBuffers();
+
+	// frame command buffers are recorded every frame, only image ownership is reset
+	imagesInFlight_.assign(imageViews_.size(), VK_NULL_HANDLE);
 }
 
-void VulkanApp::onWindowResized(GLFWwindow* window, int width, int height)
+// destroyed once every frame slot has been waited on, so gpu is done with it
+void VulkanApp::deferDestroy(std::function<void()> destroy)
 {
-	if (width == 0 || height == 0) return;
+	deletionQueue_.push(frameNumber_ + frames_.size(), std::move(destroy));
+}
 
+void VulkanApp::onWindowResized(GLFWwindow* window, int width, int height)
+{
+	// drag resize sends many events per frame, they collapse into one recreation
 	VulkanApp* app = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(window));
-	app->recreateSwapchain();
+	app->resizePending_ = true;
 }
 
 void VulkanApp::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, 
-	VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+	VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& allocation)
 {
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -940,80 +1953,316 @@ void VulkanApp::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 	bufferInfo.usage = usage;
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
-		throw std::runtime_error("failed to create buffer!");
+	allocator_.createBuffer(bufferInfo, properties, buffer, allocation);
+}
+
+void VulkanApp::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage,
+	VkMemoryPropertyFlags properties, VkImage& image, Allocation& allocation)
+{
+	VkImageCreateInfo imageInfo = { };
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = format;
+	imageInfo.extent = { width, height, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = usage;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	allocator_.createImage(imageInfo, properties, image, allocation);
+}
+
+void VulkanApp::loadMesh()
+{
+	if (options_.meshFile.empty())
+		return;
+
+	mesh_.load(options_.meshFile);
 
-	VkMemoryRequirements memoryRequiremets;
-	vkGetBufferMemoryRequirements(device_, buffer, &memoryRequiremets);
+	// data is uploaded as it is in file, so pipeline follows its layout
+	options_.compactVertices = mesh_.compactVertices();
+	options_.indexBits = mesh_.indexBits();
+}
+
+// farthest vertex from mesh origin, bounds every rotation of the mesh
+static float vertexDistance(const Vertex& vertex)
+{
+	return std::sqrt(vertex.pos.x * vertex.pos.x + vertex.pos.y * vertex.pos.y);
+}
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memoryRequiremets.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memoryRequiremets.memoryTypeBits, properties);
+static float vertexDistance(const CompactVertex& vertex)
+{
+	float x = vertex.pos.x / 32767.0f;
+	float y = vertex.pos.y / 32767.0f;
+	return std::sqrt(x * x + y * y);
+}
 
-	if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
-		throw std::runtime_error("failed to allocate vertex buffer memory!");
+template<class V>
+static float boundingRadius(const V* vertices, uint32_t count)
+{
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < count; ++i)
+		radius = std::max(radius, vertexDistance(vertices[i]));
 
-	vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+	return radius;
 }
 
 void VulkanApp::createVertexBuffer()
 {
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-	
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	// only culling needs it, mesh file pages are read for upload anyway
+	if (options_.cullObjects) {
+		if (mesh_.isLoaded() && mesh_.compactVertices())
+			meshRadius_ = boundingRadius(static_cast<const CompactVertex*>(mesh_.vertexData()), mesh_.vertexCount());
+		else if (mesh_.isLoaded())
+			meshRadius_ = boundingRadius(static_cast<const Vertex*>(mesh_.vertexData()), mesh_.vertexCount());
+		else
+			meshRadius_ = boundingRadius(vertices.data(), (uint32_t)vertices.size());
+	}
 
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	if (mesh_.isLoaded()) {
+		meshVertexCount_ = mesh_.vertexCount();
+		uploadStaticBuffer(mesh_.vertexData(), mesh_.vertexDataSize(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, vertexBuffer_, vertexBufferAllocation_);
+		return;
+	}
 
-	void* data = nullptr;
-	vkMapMemory(device_, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(device_, stagingBufferMemory);
+	meshVertexCount_ = (uint32_t)vertices.size();
 
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer_, vertexBufferMemory_);
+	if (!options_.compactVertices) {
+		uploadStaticBuffer(vertices.data(), sizeof(Vertex) * vertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, vertexBuffer_, vertexBufferAllocation_);
+		return;
+	}
 
-	copyBuffer(stagingBuffer, vertexBuffer_, bufferSize);
+	std::vector<CompactVertex> packed(vertices.size());
+	std::transform(vertices.begin(), vertices.end(), packed.begin(), packVertex);
 
-	vkFreeMemory(device_, stagingBufferMemory, nullptr);
-	vkDestroyBuffer(device_, stagingBuffer, nullptr);
+	uploadStaticBuffer(packed.data(), sizeof(CompactVertex) * packed.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, vertexBuffer_, vertexBufferAllocation_);
 }
 
-void VulkanApp::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+void VulkanApp::createIndexBuffer()
 {
-	VkCommandBufferAllocateInfo allocInfo = { };
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = commandPool_;
-	allocInfo.commandBufferCount = 1;
+	if (!options_.indexBits)
+		return;
 
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer);
+	if (options_.indexBits != 16 && options_.indexBits != 32)
+		throw std::runtime_error("index size must be 16 or 32 bits");
 
-	VkCommandBufferBeginInfo beginInfo = { };
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;		// one time submit?
+	indexType_ = options_.indexBits == 16 ? IndexFormat<uint16_t>::value : IndexFormat<uint32_t>::value;
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	if (mesh_.isLoaded()) {
+		meshIndexCount_ = mesh_.indexCount();
+		uploadStaticBuffer(mesh_.indexData(), mesh_.indexDataSize(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, indexBuffer_, indexBufferAllocation_);
+		return;
+	}
 
-	VkBufferCopy copyRegion = { }; // no offsets
-	copyRegion.size = size;
+	meshIndexCount_ = (uint32_t)indices.size();
 
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-	
-	vkEndCommandBuffer(commandBuffer);
+	if (options_.indexBits == 32) {
+		uploadStaticBuffer(indices.data(), sizeof(uint32_t) * indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, indexBuffer_, indexBufferAllocation_);
+		return;
+	}
 
-	VkSubmitInfo submitInfo = { };
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-	
-	vkQueueSubmit(graphicQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(graphicQueue_);
+	if (vertices.size() > 65536)
+		throw std::runtime_error("mesh has too many vertices for 16 bit indices");
+
+	// half the index fetch bandwidth of 32 bit indices
+	std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+	uploadStaticBuffer(shortIndices.data(), sizeof(uint16_t) * shortIndices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, indexBuffer_, indexBufferAllocation_);
+}
+
+void VulkanApp::uploadStaticBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+	VkPipelineStageFlags stage, VkAccessFlags access, VkBuffer& buffer, Allocation& allocation)
+{
+	createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, allocation);
+
+	// copied with the first frame's upload batch, frame waits for it on gpu
+	uploadEngine_.uploadBuffer(buffer, 0, data, size, stage, access);
+}
+
+// triangles on a grid, each spinning with its own phase; written front to back
+// and never read, so write-combined memory is fine
+template<class V>
+static void writeTriangleGrid(V* dst, uint32_t triangleCount, float angle)
+{
+	uint32_t columns = (uint32_t)std::ceil(std::sqrt((float)triangleCount));
+	float cell = 2.0f / columns;
+
+	for (uint32_t t = 0; t < triangleCount; ++t) {
+		glm::vec2 center(-1.0f + cell * (t % columns + 0.5f), -1.0f + cell * (t / columns + 0.5f));
+		float c = std::cos(angle + t * 0.1f);
+		float s = std::sin(angle + t * 0.1f);
+
+		for (const auto& v : vertices) {
+			Vertex vertex;
+			vertex.pos = center + glm::vec2(v.pos.x * c - v.pos.y * s, v.pos.x * s + v.pos.y * c) * cell;
+			vertex.color = v.color;
+			storeVertex(*dst++, vertex);
+		}
+	}
+}
+
+void VulkanApp::createVertexStream()
+{
+	if (!options_.streamTriangles)
+		return;
+
+	VkDeviceSize vertexSize = options_.compactVertices ? sizeof(CompactVertex) : sizeof(Vertex);
+	VkDeviceSize frameSize = vertexSize * 3 * options_.streamTriangles;
+	vertexStream_.init(physicalDevice_, device_, &allocator_, frameSize, options_.framesInFlight,
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+}
+
+void VulkanApp::updateVertexStream()
+{
+	if (!options_.streamTriangles)
+		return;
+
+	auto start = std::chrono::steady_clock::now();
+
+	vertexStream_.beginFrame((uint32_t)currentFrame_);
 
-	vkFreeCommandBuffers(device_, commandPool_, 1, &commandBuffer);
+	VkDeviceSize vertexSize = options_.compactVertices ? sizeof(CompactVertex) : sizeof(Vertex);
+	VkDeviceSize size = vertexSize * 3 * options_.streamTriangles;
+	void* dst = vertexStream_.allocate(size, sizeof(float), vertexStreamOffset_);
+	float angle = frameNumber_ * 0.02f;
+
+	if (options_.compactVertices)
+		writeTriangleGrid(static_cast<CompactVertex*>(dst), options_.streamTriangles, angle);
+	else
+		writeTriangleGrid(static_cast<Vertex*>(dst), options_.streamTriangles, angle);
+
+	vertexStream_.flush();
+
+	double cpuTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	streamStats_.bytes += size;
+	streamStats_.cpuTime += cpuTime;
+	streamTotals_.bytes += size;
+	streamTotals_.cpuTime += cpuTime;
+}
+
+void VulkanApp::createInstanceBuffers()
+{
+	// single instance that leaves vertices as they are, so pipeline needs no non-instanced variant
+	InstanceData identity;
+	identity.transform = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+	identity.color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+
+	uploadStaticBuffer(&identity, sizeof(identity), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, identityInstanceBuffer_, identityInstanceAllocation_);
+
+	if (!options_.instanceCount)
+		return;
+
+	VkDeviceSize frameSize = sizeof(InstanceData) * options_.instanceCount;
+	instanceStream_.init(physicalDevice_, device_, &allocator_, frameSize, options_.framesInFlight,
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+}
+
+void VulkanApp::updateInstances()
+{
+	if (!options_.instanceCount)
+		return;
+
+	auto start = std::chrono::steady_clock::now();
+
+	instanceStream_.beginFrame((uint32_t)currentFrame_);
+
+	VkDeviceSize size = sizeof(InstanceData) * options_.instanceCount;
+	InstanceData* dst = static_cast<InstanceData*>(instanceStream_.allocate(size, sizeof(float), instanceStreamOffset_));
+
+	// same grid as streamed triangles, but only 32 bytes per copy instead of whole mesh
+	uint32_t columns = (uint32_t)std::ceil(std::sqrt((float)options_.instanceCount));
+	float cell = 2.0f / columns;
+	float angle = frameNumber_ * 0.02f;
+
+	for (uint32_t i = 0; i < options_.instanceCount; ++i, ++dst) {
+		float x = (i % columns + 0.5f) / columns;
+		float y = (i / columns + 0.5f) / columns;
+
+		dst->transform = glm::vec4(-1.0f + 2.0f * x, -1.0f + 2.0f * y, cell, angle + i * 0.1f);
+		dst->color = glm::vec4(0.5f + 0.5f * x, 0.5f + 0.5f * y, 1.0f - 0.5f * x, 1.0f);
+	}
+
+	instanceStream_.flush();
+
+	double cpuTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	streamStats_.bytes += size;
+	streamStats_.cpuTime += cpuTime;
+	streamTotals_.bytes += size;
+	streamTotals_.cpuTime += cpuTime;
+}
+
+void VulkanApp::createParticleSystem()
+{
+	if (!options_.particleCount)
+		return;
+
+	// without compute only family dispatches are submitted to graphics queue ahead of the frame
+	const auto& indices = familyIndices_;
+	VkShaderModule shader = shaderLibrary_.load(info_.particleFile);
+	if (indices.computeFamily >= 0)
+		particles_.init(device_, &allocator_, computeQueue_, indices.computeFamily, indices.graphicFamily,
+			shader, pipelineCache_.handle(), options_.particleCount, options_.framesInFlight);
+	else
+		particles_.init(device_, &allocator_, graphicQueue_, indices.graphicFamily, indices.graphicFamily,
+			shader, pipelineCache_.handle(), options_.particleCount, options_.framesInFlight);
+
+	if (options_.verbose)
+		std::cout << "Particles: " << particles_.count() << " on " << (particles_.isAsync() ? "async compute" : "graphics")
+			<< " queue" << std::endl;
+}
+
+void VulkanApp::createGpuCulling()
+{
+	if (!options_.cullObjects)
+		return;
+
+	if (options_.streamTriangles || options_.particleCount)
+		throw std::runtime_error("gpu culling draws static mesh, it can't be combined with streamed triangles or particles");
+	if (!indexBuffer_)
+		throw std::runtime_error("gpu culling draws indexed mesh, index size can't be 0");
+	if (!enabledFeatures_.drawIndirectFirstInstance)
+		throw std::runtime_error("gpu culling needs drawIndirectFirstInstance feature");
+
+	// count draw can't be split, so every object has to fit into one; without multiDrawIndirect
+	// the limit is 1
+	uint32_t maxDrawIndirectCount = deviceProperties_.limits.maxDrawIndirectCount;
+	auto drawMode = GpuCulling::DRAW_SINGLE;
+	if (enabledFeatures_.multiDrawIndirect) {
+		bool fitsCountDraw = options_.cullObjects <= maxDrawIndirectCount;
+		drawMode = drawIndirectCount_ && fitsCountDraw ? GpuCulling::DRAW_COUNT : GpuCulling::DRAW_MULTI;
+	}
+
+	culling_.init(device_, &allocator_, shaderLibrary_.load(info_.cullFile), pipelineCache_.handle(),
+		options_.framesInFlight, drawMode, maxDrawIndirectCount);
+
+	// grid twice the screen size each way, about a quarter of objects is on screen
+	uint32_t columns = (uint32_t)std::ceil(std::sqrt((float)options_.cullObjects));
+	float cell = 4.0f / columns;
+
+	std::vector<InstanceData> objects(options_.cullObjects);
+	for (uint32_t i = 0; i < options_.cullObjects; ++i) {
+		float x = (i % columns + 0.5f) / columns;
+		float y = (i / columns + 0.5f) / columns;
+
+		objects[i].transform = glm::vec4(-2.0f + 4.0f * x, -2.0f + 4.0f * y, cell, i * 0.1f);
+		objects[i].color = glm::vec4(0.5f + 0.5f * x, 0.5f + 0.5f * y, 1.0f - 0.5f * x, 1.0f);
+	}
+
+	culling_.setObjects(uploadEngine_, objects, meshIndexCount_, meshRadius_);
+
+	if (options_.verbose) {
+		const char* modes[] = { "draw count", "multi draw", "single draws" };
+		std::cout << "GPU culling: " << culling_.objectCount() << " objects, " << modes[culling_.drawMode()] << std::endl;
+	}
 }
 
 VulkanApp::~VulkanApp()
@@ -1024,7 +2273,8 @@ VulkanApp::~VulkanApp()
 
 VKAPI_ATTR VkBool32 VKAPI_CALL VulkanApp::debugCallback(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objType, uint64_t obj, size_t location, int32_t code, const char* layerPrefix, const char* msg, void* userData)
 {
-	std::cerr << "Validation layer: " << msg << std::endl;
+	// called inside driver calls, possibly from several threads at once
+	static_cast<VulkanApp*>(userData)->debugLog_.push(flags, layerPrefix, code, msg);
 
 	return VK_FALSE;
 }
@@ -1116,5 +2366,76 @@ void VulkanApp::showInfo()
 			std::cout << std::endl;
 		}
 	}
+
+	//--------------show device memory usage------------------------
+	auto memoryStats = allocator_.getStats();
+	std::cout << "Device memory\n"
+		<< "Live: " << memoryStats.liveBytes / 1024 << " KB in " << memoryStats.allocationCount << " allocations"
+		<< "\nReserved: " << memoryStats.reservedBytes / 1024 << " KB in " << memoryStats.blockCount << " blocks, "
+		<< memoryStats.dedicatedCount << " dedicated"
+		<< "\nFragmentation: " << memoryStats.fragmentation * 100.0f << "%"
+		<< std::endl;
+}
+
+void VulkanApp::publishTelemetry()
+{
+	telemetry_.publish(getCounters(latencyHistogram_, streamStats_, telemetry_.windowTime()));
+
+	latencyHistogram_.reset();
+	streamStats_ = { };
+}
+
+VulkanApp::Results VulkanApp::results()
+{
+	Results results;
+
+	results.deviceName = deviceProperties_.deviceName;
+	results.driverVersion = deviceProperties_.driverVersion;
+	results.startupTime = startupTime_;
+	results.pipelineTime = pipelineTime_;
+	results.pipelineCacheWarm = pipelineCacheWarm_;
+
+	results.frames = telemetry_.totals();
+	results.frames.counters = getCounters(totalLatencyHistogram_, streamTotals_, results.frames.duration);
+
+	return results;
 }
 
+// latency and stream values cover given window, caller resets them
+std::vector<std::pair<std::string, double>> VulkanApp::getCounters(const Histogram& latency, const StreamStats& stream, double seconds)
+{
+	// values of other subsystems go out with frame timing report
+	std::vector<std::pair<std::string, double>> counters;
+
+	for (const auto& scope : profiler_.getStats()) {
+		counters.emplace_back("gpu " + scope.name + " ms", scope.averageTime);
+
+		for (uint32_t i = 0; scope.hasStatistics && i < GpuProfiler::STATISTIC_COUNT; ++i)
+			counters.emplace_back("gpu " + scope.name + " " + GpuProfiler::statisticName(i), scope.statistics[i]);
+	}
+
+	if (latency.count()) {
+		counters.emplace_back("input latency p50 ms", latency.percentile(0.5));
+		counters.emplace_back("input latency p99 ms", latency.percentile(0.99));
+	}
+
+	if (pacer_.isEnabled())
+		counters.emplace_back("pacer sleep ms", pacer_.sleepTime());
+
+	if (stream.frames) {
+		counters.emplace_back("stream MB/s", stream.bytes / (1024.0 * 1024.0) / std::max(seconds, 1e-6));
+		counters.emplace_back("stream cpu ms/frame", stream.cpuTime / stream.frames);
+		counters.emplace_back("stream direct", (options_.streamTriangles ? vertexStream_ : instanceStream_).isDirect() ? 1.0 : 0.0);
+	}
+
+	auto memoryStats = allocator_.getStats();
+	counters.emplace_back("memory used MB", memoryStats.usedBytes / (1024.0 * 1024.0));
+
+	if (debugLog_.isStarted()) {
+		auto logStats = debugLog_.getStats();
+		counters.emplace_back("validation messages", (double)logStats.messages);
+		counters.emplace_back("validation dropped", (double)logStats.dropped);
+	}
+
+	return counters;
+}
@@ -2,16 +2,33 @@
 #define VULKANAPP_H_
 
 #define GLFW_INCLUDE_VULKAN
-#include <GLFW\glfw3.h>
+#include <GLFW/glfw3.h>
 #include <vector>
 #include <string>
-#include <glm\glm.hpp>
-#include "timer.h"
-
-struct Vertex {
-	glm::vec2 pos;
-	glm::vec3 color;
-};
+#include <glm/glm.hpp>
+#include "pipelinecache.h"
+#include "allocator.h"
+#include "uploadengine.h"
+#include "streambuffer.h"
+#include "threadpool.h"
+#include "commandrecorder.h"
+#include "gpuprofiler.h"
+#include "frametelemetry.h"
+#include "vertexformat.h"
+#include "meshasset.h"
+#include "shaderlibrary.h"
+#include "filewatcher.h"
+#include "pipelinecompiler.h"
+#include "pipelinevariants.h"
+#include "startuptrace.h"
+#include "initgraph.h"
+#include "capabilitycache.h"
+#include "debuglog.h"
+#include "deletionqueue.h"
+#include "framepacer.h"
+#include "particlesystem.h"
+#include "gpuculling.h"
+#include "rendergraph.h"
 
 const std::vector<Vertex> vertices = {
 	{ { 0.0f, -0.5f }, { 1.0f, 1.0f, 0.0f } },
@@ -19,34 +36,203 @@ const std::vector<Vertex> vertices = {
 	{ { -0.5f, 0.5f }, { 1.0f, 0.0f, 1.0f } }
 };
 
+const std::vector<uint32_t> indices = { 0, 1, 2 };
+
 class VulkanApp {
-	GLFWwindow*	window_;
+public:
+	// present mode, swapchain length and pacing picked for kind of session
+	enum PresentProfile {
+		PRESENT_THROUGHPUT,		// mailbox or immediate, one image over minimum, no pacing - batch runs
+		PRESENT_LOW_LATENCY,	// immediate or mailbox, fewest images, paced - interactive sessions
+		PRESENT_VSYNC,			// fifo, paced so cpu sleeps instead of running ahead - saves power
+	};
+
+	struct Options {
+		bool headless = false;			// render to offscreen images, no window and surface
+		uint32_t frameCount = 0;		// frames to render before exit, 0 - until window is closed
+		uint32_t framesInFlight = 2;	// how many frames cpu can record ahead of gpu
+		PresentProfile presentProfile = PRESENT_THROUGHPUT;
+		uint32_t streamTriangles = 0;	// triangles regenerated every frame, 0 - draw static vertex buffer
+		uint32_t drawCount = 1;			// draws of static triangle, streamed triangles get one draw each
+		std::string meshFile;			// baked mesh drawn instead of built-in triangle, decides vertex layout and index size
+		bool compactVertices = false;	// snorm16 positions and unorm8 colors, 8 instead of 20 bytes per vertex
+		uint32_t indexBits = 16;		// index size of static mesh, 16 or 32, 0 - non-indexed draws
+		uint32_t instanceCount = 0;		// instances per draw, rewritten every frame, 0 - one untransformed copy
+		uint32_t particleCount = 0;		// instances simulated by compute shader instead, 0 - no particles
+		uint32_t cullObjects = 0;		// static mesh objects culled and drawn indirect by gpu, 0 - cpu draw list
+		bool postProcess = false;		// scene drawn to transient image, post subpass writes it to screen
+		uint32_t recordThreads = 0;		// threads recording draws, 0 - hardware concurrency
+		std::string telemetryFile;		// frame timing reports, *.json or csv, empty - console only
+		std::string traceFile;			// startup phases as chrome://tracing json, empty - none
+		uint32_t warmupFrames = 0;		// frames left out of results()
+		std::string deviceName;			// use first device whose name contains it, empty - any
+		uint32_t pipelineVariant = 0;	// index in declared variant set, 0 - filled, back faces culled, opaque
+		bool watchShaders = false;		// rebuild pipeline in background when files in shader directory change
+		bool verbose = true;			// print device info and per-second reports
+	};
+
+	// statistics of measured frames, valid after run() returned
+	struct Results {
+		std::string deviceName;
+		uint32_t driverVersion = 0;
+		double startupTime = 0.0;		// ms from run() to first frame submitted
+		double pipelineTime = 0.0;		// ms building all pipeline variants
+		bool pipelineCacheWarm = false;	// pipeline cache file had data for this device
+		FrameTelemetry::Report frames;
+	};
+
+private:
+	Options options_;
+
+	GLFWwindow*	window_ = nullptr;
 	VkInstance instance_ = VK_NULL_HANDLE;
 	VkSurfaceKHR surface_ = VK_NULL_HANDLE;
-	VkDebugReportCallbackEXT callback_;
+	VkDebugReportCallbackEXT callback_ = VK_NULL_HANDLE;
+	DebugLog debugLog_;			// callback only queues messages, printing happens on log thread
 	VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties deviceProperties_ = { };
+	CapabilityCache capabilityCache_;
 	VkDevice device_ = VK_NULL_HANDLE;
+	VkPhysicalDeviceFeatures enabledFeatures_ = { };
+	bool drawIndirectCount_ = false;		// VK_KHR_draw_indirect_count enabled
 	VkQueue graphicQueue_ = VK_NULL_HANDLE;
 	VkQueue presentQueue_ = VK_NULL_HANDLE;
-	VkCommandPool commandPool_ = VK_NULL_HANDLE;
+	VkQueue transferQueue_ = VK_NULL_HANDLE;
+	VkQueue computeQueue_ = VK_NULL_HANDLE;
 	VkSwapchainKHR swapchain_ = VK_NULL_HANDLE;
 	std::vector<VkImageView> imageViews_;
-	VkRenderPass renderPass_ = VK_NULL_HANDLE;
+
+	// headless mode renders into these images instead of swapchain ones
+	struct OffscreenTarget {
+		VkImage image = VK_NULL_HANDLE;
+		Allocation allocation;
+	};
+
+	std::vector<OffscreenTarget> offscreenTargets_;
+	uint32_t nextOffscreenTarget_ = 0;
+
+	// resize only sets the flag, swapchain is recreated at next frame boundary
+	bool resizePending_ = false;
+
+	// replaced swapchains, pipelines and render passes wait here until no frame in flight uses them
+	DeletionQueue deletionQueue_;
+
+	// passes of a frame, render passes, framebuffers and transient images are derived from it
+	RenderGraph renderGraph_;
+	uint32_t scenePass_ = 0;
+	uint32_t postPass_ = 0;
+	RenderGraph::Resource sceneColor_ = 0;
+	VkFormat renderPassFormat_ = VK_FORMAT_UNDEFINED;
+	VkFormat depthFormat_ = VK_FORMAT_UNDEFINED;
 	VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
-	VkPipeline graphicPipeline_ = VK_NULL_HANDLE;
-	std::vector<VkFramebuffer> framebuffers_;
-	std::vector<VkCommandBuffer> commandBuffers_;
+	PipelineVariants pipelineVariants_;
+	size_t activeVariant_ = 0;
+	PipelineCache pipelineCache_;
+	ShaderLibrary shaderLibrary_;
+
+	// shader hot reload
+	FileWatcher shaderWatcher_;
+	PipelineCompiler pipelineCompiler_;
+
+	// post pass reads scene color as input attachment, set is rewritten when targets are
+	VkDescriptorSetLayout postSetLayout_ = VK_NULL_HANDLE;
+	VkPipelineLayout postPipelineLayout_ = VK_NULL_HANDLE;
+	VkPipeline postPipeline_ = VK_NULL_HANDLE;
+	VkDescriptorPool postDescriptorPool_ = VK_NULL_HANDLE;
+	VkDescriptorSet postDescriptorSet_ = VK_NULL_HANDLE;
+
+	// resources owned by one frame in flight
+	struct FrameData {
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+		VkSemaphore renderFinishedSemaphore = VK_NULL_HANDLE;
+		VkFence inFlightFence = VK_NULL_HANDLE;
+
+		// extra semaphores submit waits on, gathered while recording
+		std::vector<VkSemaphore> waitSemaphores;
+		std::vector<VkPipelineStageFlags> waitStages;
+	};
+
+	std::vector<FrameData> frames_;
+	FramePacer pacer_;
+	Histogram latencyHistogram_;				// input sampled to present returned, ms, since last report
+	Histogram totalLatencyHistogram_;			// same, since warmup frames
+	size_t currentFrame_ = 0;
+	uint64_t frameNumber_ = 0;					// frames submitted so far
+	std::vector<VkFence> imagesInFlight_;		// fence of the frame that renders to swapchain image
+
+	// draws of current frame, big lists are recorded in parallel into secondary buffers
+	struct DrawItem {
+		uint32_t vertexCount = 0;
+		uint32_t firstVertex = 0;
+		uint32_t instanceCount = 1;
+		uint32_t indexCount = 0;		// non-zero - indexed draw, firstVertex is added to indices
+		uint32_t firstIndex = 0;
+		float depth = 0.0f;				// view space layer of the draw, 0 - nearest, pushed to vertex shader
+	};
 
-	// semaphores
-	VkSemaphore imageAvailableSemaphore_ = VK_NULL_HANDLE;
-	VkSemaphore renderFinishedSemaphore_ = VK_NULL_HANDLE;
+	std::vector<DrawItem> drawList_;
+	bool parallelDraws_ = false;		// draw list of current frame goes to secondary buffers
+	ThreadPool threadPool_;
+	CommandRecorder recorder_;
+	std::vector<VkCommandBuffer> secondaryBuffers_;
 
 	// buffers
 	VkBuffer vertexBuffer_ = VK_NULL_HANDLE;
-	VkDeviceMemory vertexBufferMemory_ = VK_NULL_HANDLE;
+	Allocation vertexBufferAllocation_;
+	VkBuffer indexBuffer_ = VK_NULL_HANDLE;
+	Allocation indexBufferAllocation_;
+	VkIndexType indexType_ = VK_INDEX_TYPE_UINT16;
+	uint32_t meshVertexCount_ = 0;
+	uint32_t meshIndexCount_ = 0;
+
+	// mapped only until its sections are copied to staging memory
+	MeshAsset mesh_;
+
+	// animated geometry written every frame
+	StreamBuffer vertexStream_;
+	VkDeviceSize vertexStreamOffset_ = 0;
+
+	// instance attributes, identity buffer is bound when instancing is off
+	VkBuffer identityInstanceBuffer_ = VK_NULL_HANDLE;
+	Allocation identityInstanceAllocation_;
+	StreamBuffer instanceStream_;
+	VkDeviceSize instanceStreamOffset_ = 0;
+
+	// gpu simulated instances, replace instance stream when enabled
+	ParticleSystem particles_;
+
+	// objects spread over area larger than screen, replace draw list when enabled
+	GpuCulling culling_;
+	float meshRadius_ = 0.0f;		// bounding circle of mesh vertices, computed only for culling
+
+	// vertex and instance streams together
+	struct StreamStats {
+		VkDeviceSize bytes = 0;
+		double cpuTime = 0.0;			// ms spent generating and writing
+		uint32_t frames = 0;
+	};
 
-	// timer for fps
-	Timer timer_;
+	StreamStats streamStats_;		// since last report
+	StreamStats streamTotals_;		// since warmup frames
+
+	// all buffer and image memory comes from here
+	Allocator allocator_;
+	UploadEngine uploadEngine_;
+
+	// cpu frame timing, replaces fps counter
+	FrameTelemetry telemetry_;
+
+	// gpu time of frame scopes
+	GpuProfiler profiler_;
+
+	// init phases up to first frame
+	StartupTrace trace_;
+	StartupTrace::Clock::time_point initEnd_;
+	double startupTime_ = 0.0;		// ms
+	double pipelineTime_ = 0.0;		// ms, last createGraphicsPipeline()
+	bool pipelineCacheWarm_ = false;
 
 	struct {					// struct for application info
 		int WIDTH = 800;
@@ -69,16 +255,33 @@ class VulkanApp {
 #endif
 
 		// shader files
+		const char* shaderDirectory = "shaders";
 		const char* vertexFile = "shaders/vert.spv";
 		const char* fragmentFile = "shaders/frag.spv";
+		const char* vertexSource = "shaders/shader.vert";
+		const char* fragmentSource = "shaders/shader.frag";
+		const char* particleFile = "shaders/particles.spv";
+		const char* cullFile = "shaders/cull.spv";
+		const char* postVertexFile = "shaders/postvert.spv";
+		const char* postFragmentFile = "shaders/postfrag.spv";
+
+		// compiled pipelines kept between runs
+		const char* pipelineCacheFile = "pipeline_cache.bin";
+
+		// layer and extension checks passed on earlier runs
+		const char* capabilityCacheFile = "capabilities.bin";
 
 	} info_;
 
 	struct FamilyIndices {
 		int32_t graphicFamily = -1;
 		int32_t presentFamily = -1;
+		int32_t transferFamily = -1;	// transfer only family (dma engine), -1 if device has none
+		int32_t computeFamily = -1;		// compute family without graphics (async compute), -1 if device has none
 	};
 
+	FamilyIndices familyIndices_;		// of picked device
+
 private:
 	void initAppInfo();
 	void initWindow();		// main functions
@@ -89,39 +292,74 @@ private:
 	void createDevice();
 	void createSurface();
 	void createSwapchain();
-	void createRenderPass();
+	void createOffscreenTargets();
+	void createRenderGraph();
+	void createPipelineCache();
+	void createShaderLibrary();
+	void createAllocator();
+	void createUploadEngine();
+	void createThreadPool();
 	void createGraphicsPipeline();
-	void createCommandPool();
+	std::vector<PipelineKey> declarePipelineVariants();
+	VkPipeline buildGraphicsPipeline(VkShaderModule vertexShader, VkShaderModule fragmentShader,
+		const PipelineKey&, VkPipelineCreateFlags, VkPipeline basePipeline);
+	void createPostPipeline();
+	void createShaderWatcher();
+	void updateShaders();
+	void createRecorder();
+	void createProfiler();
 	void createFramebuffers();
-	void createCommandBuffers();
-	void createSemaphores();
+	void createPostDescriptorSet();
+	void createFrames();
+
+	void buildDrawList();
+	void recordCommandBuffer(FrameData&, uint32_t imageIndex);
+	void recordScene(const RenderGraph::PassContext&);
+	void recordPost(const RenderGraph::PassContext&);
+	void recordDraws(VkCommandBuffer, uint32_t firstDraw, uint32_t drawCount);
 
 	void drawFrame();
+	void finishStartup();
+	bool acquireNextImage(VkSemaphore, uint32_t& imageIndex);		// false if swapchain is out of date
+	void presentImage(uint32_t imageIndex, VkSemaphore);
 
 	void mainLoop();
 	void cleanup();
+	void destroyDevice();
 
 	void recreateSwapchain();
+	void deferDestroy(std::function<void()> destroy);
 	static void onWindowResized(GLFWwindow*, int width, int height);
 
-	void createBuffer(VkDeviceSize, VkBufferUsageFlags, VkMemoryPropertyFlags, VkBuffer&, VkDeviceMemory&);
+	void createBuffer(VkDeviceSize, VkBufferUsageFlags, VkMemoryPropertyFlags, VkBuffer&, Allocation&);
+	void createImage(uint32_t width, uint32_t height, VkFormat, VkImageUsageFlags, VkMemoryPropertyFlags, VkImage&, Allocation&);
+	void loadMesh();
 	void createVertexBuffer();
-	void copyBuffer(VkBuffer, VkBuffer, VkDeviceSize);
+	void createIndexBuffer();
+	void uploadStaticBuffer(const void*, VkDeviceSize, VkBufferUsageFlags, VkPipelineStageFlags,
+		VkAccessFlags, VkBuffer&, Allocation&);
+	void createVertexStream();
+	void updateVertexStream();
+	void createInstanceBuffers();
+	void updateInstances();
+	void createParticleSystem();
+	void createGpuCulling();
 
 private:		// help functions
 	FamilyIndices getFamilyIndices(VkPhysicalDevice device);
 	void checkInstanceLayersSupport();
 	void checkInstanceExtenstionsSupport();
 	bool checkDeviceExtensionSupport(VkPhysicalDevice);
+	bool hasDeviceExtension(VkPhysicalDevice, const char* name);
 	void setupDebugCallback();
-	static std::vector<char> readFile(const std::string& filename);
-	void createShaderModule(const std::vector<char>&, VkShaderModule&);
 	uint32_t findMemoryType(uint32_t, VkMemoryPropertyFlags);
 	
 	// functions for creating swap chain
 	VkSurfaceCapabilitiesKHR getSurfaceCapabilities();
 	VkSurfaceFormatKHR getSurfaceFormat();
+	VkFormat getDepthFormat();
 	VkPresentModeKHR getPresentMode();
+	uint32_t getImageCount(const VkSurfaceCapabilitiesKHR&, VkPresentModeKHR);
 
 	// debug functions
 	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugReportFlagsEXT flags,
@@ -129,11 +367,17 @@ private:		// help functions
 		const char* layerPrefix, const char* msg, void* userData);
 
 	void showInfo();		// super help function for me, delete after relise
+	void publishTelemetry();
+	std::vector<std::pair<std::string, double>> getCounters(const Histogram& latency, const StreamStats& stream, double seconds);
 
 public:
-	void run();
+	VulkanApp() = default;
+	explicit VulkanApp(const Options& options);
 	~VulkanApp();
 
+	void run();
+	Results results();
+
 };
 
 #endif // VULKANAPP_H_
\ No newline at end of file